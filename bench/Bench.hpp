@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Shared state for the benchmarks in nwtrees_bench, which are BENCHMARK_METHODs run by bench/main.cpp.
+namespace bench
+{
+    struct CorpusFile
+    {
+        std::string path;
+        std::string data;
+    };
+
+    // Every .nss file under the corpus directory, read into memory before any benchmark runs.
+    const std::vector<CorpusFile>& corpus();
+
+    // Passes to run untimed before measuring, and passes to measure.
+    int warmup_passes();
+    int passes();
+
+    // Adds a result to the report, the JSON output and the comparison against the baseline.
+    // Results are matched to the baseline by name, so names should stay stable between builds.
+    void record(const std::string& name, double value, const char* unit, bool higher_is_better);
+
+    // The sample fraction (0 to 1) of the way through samples, once sorted.
+    double percentile(std::vector<double> samples, double fraction);
+}
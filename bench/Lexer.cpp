@@ -0,0 +1,283 @@
+#include "Bench.hpp"
+#include "UnitTest.hpp"
+
+#include <nwtrees/Lexer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <ctype.h>
+#include <string>
+#include <string_view>
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    double seconds_between(const Clock::time_point before, const Clock::time_point after)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count() / 1e9;
+    }
+
+    enum Category
+    {
+        Keywords,
+        Identifiers,
+        Strings,
+        Ints,
+        Floats,
+        Punctuators,
+
+        CategoryCount
+    };
+
+    static constexpr const char* category_names[CategoryCount] = { "keyword", "identifier", "string", "int", "float", "punctuator" };
+
+    Category categorize(const nwtrees::Token& token)
+    {
+        switch (token.type)
+        {
+            case nwtrees::Token::Keyword: return Keywords;
+            case nwtrees::Token::Identifier: return Identifiers;
+            case nwtrees::Token::Punctuator: return Punctuators;
+            default: break;
+        }
+
+        switch (token.literal)
+        {
+            case nwtrees::Literal::String: return Strings;
+            case nwtrees::Literal::Int: return Ints;
+            default: return Floats;
+        }
+    }
+
+    // The source text of a token, as far as it can be rebuilt from the lexer's output.
+    std::string token_text(const nwtrees::LexerOutput& lex, const std::string& source, const size_t idx)
+    {
+        const nwtrees::Token& token = lex.tokens[idx];
+
+        switch (categorize(token))
+        {
+            case Keywords: return std::string(nwtrees::keywords[(size_t)token.keyword].first);
+            case Punctuators: return std::string(nwtrees::punctuators[(size_t)token.punctuator].first);
+            case Identifiers: return std::string(lex.text(token.identifier_data));
+            case Strings: return "\"" + std::string(lex.text(token.literal_data.str)) + "\"";
+            default: break;
+        }
+
+        // Numbers keep no text, but run up to the next token, less whatever whitespace and comments come between:
+        // a number never holds either, so it ends at the first of them.
+        const size_t start = (size_t)lex.offsets[idx];
+        const size_t next = idx + 1 < lex.offsets.size() ? (size_t)lex.offsets[idx + 1] : source.size();
+        size_t end = start;
+        while (end < next && !isspace((unsigned char)source[end]) && source[end] != '/') ++end;
+        return source.substr(start, end - start);
+    }
+
+    struct Measurement
+    {
+        // The fastest pass: on a busy machine, noise only ever adds time.
+        double best_seconds;
+        std::vector<double> file_seconds;
+    };
+
+    // Lexes every input once per pass, timing each one, after the warmup passes.
+    template <typename Input, typename Config = nwtrees::LexerConfig>
+    Measurement measure(const std::vector<Input>& inputs, std::string_view (*view)(const Input&), const nwtrees::LexerOptions& options = {})
+    {
+        nwtrees::LexerOutput output;
+        Measurement measurement;
+        std::vector<double> pass_seconds;
+
+        for (int pass = -bench::warmup_passes(); pass < bench::passes(); ++pass)
+        {
+            double total = 0.0;
+
+            for (const Input& input : inputs)
+            {
+                const auto before = Clock::now();
+                output = nwtrees::lexer<Config>(view(input), std::move(output), options);
+                const double seconds = seconds_between(before, Clock::now());
+
+                total += seconds;
+                if (pass >= 0) measurement.file_seconds.push_back(seconds);
+            }
+
+            if (pass >= 0) pass_seconds.push_back(total);
+        }
+
+        measurement.best_seconds = bench::percentile(pass_seconds, 0.0);
+        return measurement;
+    }
+
+    static constexpr double megabyte = 1024.0 * 1024.0;
+}
+
+BENCHMARK_CLASS(Lexer)
+{
+    BENCHMARK_METHOD(Corpus)
+    {
+        const std::vector<bench::CorpusFile>& corpus = bench::corpus();
+        TEST_EXPECT(!corpus.empty());
+        if (corpus.empty()) return;
+
+        size_t bytes = 0;
+        size_t tokens = 0;
+        size_t failed = 0;
+
+        for (const bench::CorpusFile& file : corpus)
+        {
+            const nwtrees::LexerOutput lex = nwtrees::lexer(file.data);
+            bytes += file.data.size();
+            tokens += lex.tokens.size();
+            failed += !lex.errors.empty();
+        }
+
+        const Measurement measurement = measure<bench::CorpusFile>(corpus,
+            [](const bench::CorpusFile& file) { return std::string_view(file.data); });
+
+        printf("    %zu tokens; %zu files stop at an error\n", tokens, failed);
+
+        bench::record("lexer.corpus.throughput", bytes / measurement.best_seconds / megabyte, "MB/s", true);
+        bench::record("lexer.corpus.tokens", tokens / measurement.best_seconds / 1e6, "Mtok/s", true);
+        bench::record("lexer.corpus.file_min", bench::percentile(measurement.file_seconds, 0.0) * 1e6, "us", false);
+        bench::record("lexer.corpus.file_median", bench::percentile(measurement.file_seconds, 0.5) * 1e6, "us", false);
+        bench::record("lexer.corpus.file_p99", bench::percentile(measurement.file_seconds, 0.99) * 1e6, "us", false);
+    }
+
+    BENCHMARK_METHOD(Categories)
+    {
+        // Each category's tokens from the whole corpus, one input per category, so each tokenizer is timed on its own.
+        std::string inputs[CategoryCount];
+        size_t counts[CategoryCount] = {};
+
+        for (const bench::CorpusFile& file : bench::corpus())
+        {
+            const nwtrees::LexerOutput lex = nwtrees::lexer(file.data);
+
+            for (size_t i = 0; i < lex.tokens.size(); ++i)
+            {
+                const Category category = categorize(lex.tokens[i]);
+                inputs[category] += token_text(lex, file.data, i);
+
+                // Adjacent string literals would be merged into one; a comma keeps them apart.
+                inputs[category] += category == Strings ? ", " : " ";
+                ++counts[category];
+            }
+        }
+
+        for (int category = 0; category < CategoryCount; ++category)
+        {
+            if (!counts[category]) continue;
+
+            const std::vector<std::string> input = { inputs[category] };
+            const nwtrees::LexerOutput check = nwtrees::lexer(input[0]);
+            TEST_EXPECT(check.errors.empty());
+            TEST_EXPECT(check.tokens.size() == counts[category] * (category == Strings ? 2 : 1));
+
+            const Measurement measurement = measure<std::string>(input, [](const std::string& str) { return std::string_view(str); });
+
+            const std::string name = std::string("lexer.category.") + category_names[category];
+            bench::record(name + ".throughput", input[0].size() / measurement.best_seconds / megabyte, "MB/s", true);
+            bench::record(name + ".tokens", counts[category] / measurement.best_seconds / 1e6, "Mtok/s", true);
+        }
+    }
+
+    BENCHMARK_METHOD(Layouts)
+    {
+        const std::vector<bench::CorpusFile>& corpus = bench::corpus();
+
+        size_t bytes = 0;
+        for (const bench::CorpusFile& file : corpus) bytes += file.data.size();
+
+        nwtrees::LexerOptions arrays;
+        arrays.layout = nwtrees::TokenLayout::Arrays;
+
+        const auto view = [](const bench::CorpusFile& file) { return std::string_view(file.data); };
+        bench::record("lexer.layout.structs.throughput", bytes / measure<bench::CorpusFile>(corpus, view).best_seconds / megabyte, "MB/s", true);
+        bench::record("lexer.layout.arrays.throughput", bytes / measure<bench::CorpusFile>(corpus, view, arrays).best_seconds / megabyte, "MB/s", true);
+
+        // A pass that only cares what each token is: counting blocks over the whole corpus.
+        std::vector<nwtrees::LexerOutput> structs_lex, arrays_lex;
+        size_t tokens = 0;
+
+        for (const bench::CorpusFile& file : corpus)
+        {
+            structs_lex.push_back(nwtrees::lexer(file.data));
+            arrays_lex.push_back(nwtrees::lexer(file.data, nwtrees::LexerOutput(), arrays));
+            tokens += structs_lex.back().tokens.size();
+        }
+
+        static constexpr nwtrees::TokenKind left_curly = nwtrees::token_kind::of(nwtrees::Punctuator::LeftCurlyBracket);
+
+        double structs_best = 1e30, arrays_best = 1e30;
+        size_t structs_blocks = 0, arrays_blocks = 0;
+
+        for (int pass = -bench::warmup_passes(); pass < bench::passes(); ++pass)
+        {
+            const auto before = Clock::now();
+
+            structs_blocks = 0;
+            for (const nwtrees::LexerOutput& lex : structs_lex)
+            {
+                for (const nwtrees::Token& token : lex.tokens)
+                {
+                    structs_blocks += token.type == nwtrees::Token::Punctuator && token.punctuator == nwtrees::Punctuator::LeftCurlyBracket;
+                }
+            }
+
+            const auto middle = Clock::now();
+
+            arrays_blocks = 0;
+            for (const nwtrees::LexerOutput& lex : arrays_lex)
+            {
+                for (const nwtrees::TokenKind kind : lex.kinds) arrays_blocks += kind == left_curly;
+            }
+
+            const auto after = Clock::now();
+
+            if (pass >= 0)
+            {
+                structs_best = std::min(structs_best, seconds_between(before, middle));
+                arrays_best = std::min(arrays_best, seconds_between(middle, after));
+            }
+        }
+
+        TEST_EXPECT(structs_blocks == arrays_blocks);
+
+        bench::record("lexer.layout.structs.kind_scan", tokens / structs_best / 1e6, "Mtok/s", true);
+        bench::record("lexer.layout.arrays.kind_scan", tokens / arrays_best / 1e6, "Mtok/s", true);
+    }
+
+    BENCHMARK_METHOD(Names)
+    {
+        const std::vector<bench::CorpusFile>& corpus = bench::corpus();
+
+        size_t bytes = 0;
+        for (const bench::CorpusFile& file : corpus) bytes += file.data.size();
+
+        nwtrees::LexerOptions source_names;
+        source_names.source_names = true;
+
+        const auto view = [](const bench::CorpusFile& file) { return std::string_view(file.data); };
+        bench::record("lexer.names.copied.throughput", bytes / measure<bench::CorpusFile>(corpus, view).best_seconds / megabyte, "MB/s", true);
+        bench::record("lexer.names.source.throughput", bytes / measure<bench::CorpusFile>(corpus, view, source_names).best_seconds / megabyte, "MB/s", true);
+    }
+
+    BENCHMARK_METHOD(Configs)
+    {
+        const std::vector<bench::CorpusFile>& corpus = bench::corpus();
+
+        size_t bytes = 0;
+        for (const bench::CorpusFile& file : corpus) bytes += file.data.size();
+
+        // What the compiler asks for, with everything compiled in, and with only that.
+        nwtrees::LexerOptions options;
+        options.directives = true;
+        options.source_names = true;
+
+        const auto view = [](const bench::CorpusFile& file) { return std::string_view(file.data); };
+        bench::record("lexer.config.default.throughput", bytes / measure<bench::CorpusFile>(corpus, view, options).best_seconds / megabyte, "MB/s", true);
+        bench::record("lexer.config.compile.throughput",
+            bytes / measure<bench::CorpusFile, nwtrees::CompileLexerConfig>(corpus, view, options).best_seconds / megabyte, "MB/s", true);
+    }
+};
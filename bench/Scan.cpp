@@ -0,0 +1,68 @@
+#include "Bench.hpp"
+#include "UnitTest.hpp"
+
+#include <nwtrees/util/Scan.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+BENCHMARK_CLASS(Scan)
+{
+    BENCHMARK_METHOD(Throughput)
+    {
+        using ScanFunc = const char*(*)(const char*, const char*);
+
+        // Long runs are where the vector backends pay off: banners, indentation and long comment lines.
+        std::string banner = "*";
+        for (int i = 0; i < 64 * 1024; ++i) banner += i % 80 == 79 ? '\n' : '*';
+        banner += "*/";
+
+        std::string indentation;
+        for (int i = 0; i < 64 * 1024; ++i) indentation += i % 40 == 39 ? '\n' : (i % 8 == 0 ? '\t' : ' ');
+        indentation += "x";
+
+        const std::string line = std::string(64 * 1024, '=') + "\n";
+
+        struct Case
+        {
+            const char* name;
+            ScanFunc scan;
+            const std::string& input;
+        };
+
+        const Case cases[] =
+        {
+            { "find_comment_end", &nwtrees::scan::find_comment_end, banner },
+            { "skip_whitespace", &nwtrees::scan::skip_whitespace, indentation },
+            { "find_newline", &nwtrees::scan::find_newline, line },
+        };
+
+        for (const Case& c : cases)
+        {
+            static constexpr int iterations = 200;
+
+            double best_seconds = 1e30;
+            const char* end = nullptr;
+
+            for (int pass = -bench::warmup_passes(); pass < bench::passes(); ++pass)
+            {
+                const auto before = std::chrono::high_resolution_clock::now();
+
+                for (int i = 0; i < iterations; ++i)
+                {
+                    end = c.scan(c.input.data(), c.input.data() + c.input.size());
+                }
+
+                const auto after = std::chrono::high_resolution_clock::now();
+                const double seconds = std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count() / 1e9;
+                if (pass >= 0) best_seconds = std::min(best_seconds, seconds);
+            }
+
+            TEST_EXPECT(end == c.input.c_str() + c.input.size() - 1);
+
+            const double bytes = (double)(end - c.input.c_str()) * iterations;
+            bench::record(std::string("scan.") + c.name, bytes / best_seconds / (1024.0 * 1024.0), "MB/s", true);
+        }
+    }
+};
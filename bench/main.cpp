@@ -0,0 +1,274 @@
+#include "Bench.hpp"
+#include "UnitTest.hpp"
+
+#include <nwtrees/Lexer.hpp>
+#include <nwtrees/util/Assert.hpp>
+#include <nwtrees/util/Scan.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace
+{
+    struct Result
+    {
+        std::string name;
+        double value;
+        std::string unit;
+        bool higher_is_better;
+    };
+
+    std::vector<bench::CorpusFile> s_corpus;
+    std::vector<Result> s_results;
+    int s_warmup_passes = 2;
+    int s_passes = 10;
+
+    void print_usage()
+    {
+        printf("Usage: nwtrees_bench [options] corpus\n");
+        printf("  --warmup N         Untimed passes before measuring. Defaults to 2.\n");
+        printf("  --passes N         Timed passes. Defaults to 10.\n");
+        printf("  --filter STR       Only run benchmarks whose name contains STR.\n");
+        printf("  --json FILE        Write the results to FILE.\n");
+        printf("  --baseline FILE    Compare the results against FILE, written by an earlier --json.\n");
+        printf("  --threshold PCT    Fail if any result is more than PCT percent worse than the baseline. Defaults to 5.\n");
+    }
+
+    bool load_corpus(const std::filesystem::path& folder)
+    {
+        std::error_code error;
+        if (!std::filesystem::is_directory(folder, error)) return false;
+
+        for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(folder))
+        {
+            if (entry.is_regular_file() && entry.path().extension() == ".nss")
+            {
+                std::ifstream file(entry.path(), std::ios::binary);
+                std::stringstream contents;
+                contents << file.rdbuf();
+                s_corpus.push_back({ entry.path().string(), contents.str() });
+            }
+        }
+
+        // Directory order isn't stable; keep runs comparable.
+        std::sort(std::begin(s_corpus), std::end(s_corpus),
+            [](const bench::CorpusFile& lhs, const bench::CorpusFile& rhs) { return lhs.path < rhs.path; });
+
+        return true;
+    }
+
+    bool write_json(const char* path)
+    {
+        FILE* file = fopen(path, "w");
+        if (!file) return false;
+
+        fprintf(file, "{\n");
+        fprintf(file, "    \"lexer_version\": %u,\n", nwtrees::lexer_version);
+        fprintf(file, "    \"simd\": \"%s\",\n", nwtrees::scan::backend_name());
+        fprintf(file, "    \"corpus_files\": %zu,\n", s_corpus.size());
+        fprintf(file, "    \"results\":\n    [\n");
+
+        for (size_t i = 0; i < s_results.size(); ++i)
+        {
+            const Result& result = s_results[i];
+            fprintf(file, "        { \"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\", \"higher_is_better\": %s }%s\n",
+                result.name.c_str(), result.value, result.unit.c_str(), result.higher_is_better ? "true" : "false",
+                i + 1 < s_results.size() ? "," : "");
+        }
+
+        fprintf(file, "    ]\n}\n");
+        return fclose(file) == 0;
+    }
+
+    // Only needs to read back what write_json writes: one result per line.
+    bool read_baseline(const char* path, std::vector<Result>* results)
+    {
+        FILE* file = fopen(path, "r");
+        if (!file) return false;
+
+        char line[1024];
+
+        while (fgets(line, sizeof(line), file))
+        {
+            char name[256];
+            double value;
+
+            if (sscanf(line, " { \"name\": \"%255[^\"]\", \"value\": %lf", name, &value) == 2)
+            {
+                results->push_back({ name, value, "", true });
+            }
+        }
+
+        fclose(file);
+        return true;
+    }
+
+    // Returns the number of results that regressed by more than threshold percent.
+    int compare(const std::vector<Result>& baseline, const double threshold)
+    {
+        int regressions = 0;
+
+        printf("\nAgainst baseline (threshold %.1f%%):\n", threshold);
+
+        for (const Result& result : s_results)
+        {
+            const auto base = std::find_if(std::begin(baseline), std::end(baseline),
+                [&](const Result& candidate) { return candidate.name == result.name; });
+
+            if (base == std::end(baseline) || base->value == 0.0)
+            {
+                printf("    %-40s %12.2f %-6s (new)\n", result.name.c_str(), result.value, result.unit.c_str());
+                continue;
+            }
+
+            const double change = (result.value - base->value) / base->value * 100.0;
+            const double worse_by = result.higher_is_better ? -change : change;
+            const bool regressed = worse_by > threshold;
+            regressions += regressed;
+
+            printf("    %-40s %12.2f -> %12.2f %-6s %+7.2f%%%s\n", result.name.c_str(), base->value, result.value,
+                result.unit.c_str(), change, regressed ? "  REGRESSED" : "");
+        }
+
+        return regressions;
+    }
+}
+
+const std::vector<bench::CorpusFile>& bench::corpus()
+{
+    return s_corpus;
+}
+
+int bench::warmup_passes()
+{
+    return s_warmup_passes;
+}
+
+int bench::passes()
+{
+    return s_passes;
+}
+
+void bench::record(const std::string& name, const double value, const char* unit, const bool higher_is_better)
+{
+    printf("    %-40s %12.2f %s\n", name.c_str(), value, unit);
+    s_results.push_back({ name, value, unit, higher_is_better });
+}
+
+double bench::percentile(std::vector<double> samples, const double fraction)
+{
+    if (samples.empty()) return 0.0;
+    std::sort(std::begin(samples), std::end(samples));
+    const size_t idx = std::min(samples.size() - 1, (size_t)(fraction * (double)(samples.size() - 1) + 0.5));
+    return samples[idx];
+}
+
+int main(int argc, char** argv)
+{
+    const char* corpus_path = nullptr;
+    const char* filter = nullptr;
+    const char* json_path = nullptr;
+    const char* baseline_path = nullptr;
+    double threshold = 5.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--warmup") == 0 && has_value) s_warmup_passes = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--passes") == 0 && has_value) s_passes = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--filter") == 0 && has_value) filter = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && has_value) json_path = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && has_value) baseline_path = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && has_value) threshold = atof(argv[++i]);
+        else if (argv[i][0] != '-') corpus_path = argv[i];
+        else
+        {
+            print_usage();
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (!corpus_path)
+    {
+        print_usage();
+        return 1;
+    }
+
+    if (!load_corpus(corpus_path))
+    {
+        printf("ERROR: %s: not a directory\n", corpus_path);
+        return 1;
+    }
+
+    size_t corpus_bytes = 0;
+    for (const bench::CorpusFile& file : s_corpus) corpus_bytes += file.data.size();
+
+    printf("Corpus: %zu files, %.2f MB; %d warmup and %d timed passes; %s skip routines\n",
+        s_corpus.size(), corpus_bytes / (1024.0 * 1024.0), s_warmup_passes, s_passes, nwtrees::scan::backend_name());
+
+    bool any_failures = false;
+
+    for (const test::UnitTest& benchmark : test::registered_unit_tests())
+    {
+        char name_buf[4096];
+        snprintf(name_buf, sizeof(name_buf), "%s_%s", benchmark.class_name, benchmark.test_name);
+
+        if (filter && !strstr(name_buf, filter)) continue;
+
+        printf("\n%s\n", name_buf);
+        fflush(stdout);
+
+        nwtrees::assert::g_fail_count = 0;
+
+        const test::AllocationCounts allocations_before = test::allocations();
+        const test::UnitTestResult result = benchmark.function();
+        const test::AllocationCounts allocations_after = test::allocations();
+
+        // Includes setup, such as the benchmark's own copies of the corpus.
+        printf("    %-40s %12lld allocations, %lld bytes\n", "heap",
+            (long long)(allocations_after.allocations - allocations_before.allocations), (long long)(allocations_after.bytes - allocations_before.bytes));
+
+        if (result.failed_condition)
+        {
+            printf("    FAILED!\n    %s:%d\n    %s\n", result.failed_file, result.failed_line, result.failed_condition);
+            any_failures = true;
+        }
+        else if (nwtrees::assert::g_fail_count)
+        {
+            printf("    FAILED!\n    Failed %d asserts.\n", nwtrees::assert::g_fail_count);
+            any_failures = true;
+        }
+
+        fflush(stdout);
+    }
+
+    if (json_path && !write_json(json_path))
+    {
+        printf("ERROR: %s: could not be written\n", json_path);
+        any_failures = true;
+    }
+
+    if (baseline_path)
+    {
+        std::vector<Result> baseline;
+
+        if (!read_baseline(baseline_path, &baseline))
+        {
+            printf("ERROR: %s: could not be read\n", baseline_path);
+            return 1;
+        }
+
+        const int regressions = compare(baseline, threshold);
+        if (regressions) printf("\n%d result(s) regressed.\n", regressions);
+        any_failures = any_failures || regressions;
+    }
+
+    fflush(stdout);
+    return any_failures ? 1 : 0;
+}
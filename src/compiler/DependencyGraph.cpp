@@ -0,0 +1,444 @@
+#include "DependencyGraph.hpp"
+#include "IncludeCache.hpp"
+#include "SourceFile.hpp"
+
+#include <nwtrees/util/Hash.hpp>
+
+#include <charconv>
+#include <stdio.h>
+#include <system_error>
+
+namespace
+{
+    // Bump whenever the format below changes.
+    static constexpr int graph_version = 1;
+
+    std::string normalise(const std::filesystem::path& path);
+    bool next_field(std::string_view& line, std::string_view* field);
+    template <typename T> bool parse(std::string_view field, T* value);
+    int64_t write_time(const std::filesystem::path& path, std::error_code& error);
+}
+
+DependencyGraph::DependencyGraph(std::filesystem::path path, const uint64_t config)
+    : m_path(std::move(path)),
+      m_config(config)
+{
+}
+
+// One line per file, then one per include, each file's index being its place among the file lines:
+//   nwtrees-deps <version> <config>
+//   f <size> <time> <hash> <script> <failed> <path>
+//   i <from> <target or -1> <name>
+bool DependencyGraph::load()
+{
+    m_nodes.clear();
+    m_by_path.clear();
+
+    FILE* file = fopen(m_path.string().c_str(), "rb");
+    if (!file) return false;
+
+    std::string data;
+    char buffer[64 * 1024];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) data.append(buffer, read);
+    fclose(file);
+
+    std::string_view rest = data;
+    bool valid = true;
+    bool first = true;
+
+    while (valid && !rest.empty())
+    {
+        const size_t line_end = rest.find('\n');
+        std::string_view line = rest.substr(0, line_end);
+        rest = line_end == std::string_view::npos ? std::string_view() : rest.substr(line_end + 1);
+
+        std::string_view kind;
+        if (!next_field(line, &kind)) continue;
+
+        if (first)
+        {
+            std::string_view version;
+            std::string_view config;
+            int version_value = 0;
+            uint64_t config_value = 0;
+
+            valid = kind == "nwtrees-deps" && next_field(line, &version) && parse(version, &version_value) && version_value == graph_version &&
+                next_field(line, &config) && parse(config, &config_value) && config_value == m_config;
+            first = false;
+        }
+        else if (kind == "f")
+        {
+            Node node;
+            std::string_view size, time, hash, script, failed;
+            int flag = 0;
+
+            valid = next_field(line, &size) && parse(size, &node.size) && next_field(line, &time) && parse(time, &node.time) &&
+                next_field(line, &hash) && parse(hash, &node.hash) && next_field(line, &script) && parse(script, &flag) &&
+                next_field(line, &failed) && !line.empty();
+
+            node.script = flag != 0;
+            valid = valid && parse(failed, &flag);
+            node.failed = flag != 0;
+            node.path = std::string(line);
+
+            if (valid)
+            {
+                m_by_path.emplace(node.path, (int)m_nodes.size());
+                m_nodes.push_back(std::move(node));
+            }
+        }
+        else if (kind == "i")
+        {
+            std::string_view from, target;
+            int from_idx = 0;
+            Include include;
+
+            valid = next_field(line, &from) && parse(from, &from_idx) && next_field(line, &target) && parse(target, &include.target) &&
+                from_idx >= 0 && from_idx < (int)m_nodes.size() && include.target >= -1 && include.target < (int)m_nodes.size();
+
+            include.name = std::string(line);
+            if (valid) m_nodes[from_idx].includes.push_back(std::move(include));
+        }
+        else
+        {
+            valid = false;
+        }
+    }
+
+    if (!valid || first)
+    {
+        m_nodes.clear();
+        m_by_path.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool DependencyGraph::save() const
+{
+    std::vector<char> reached(m_nodes.size(), 0);
+    std::vector<char> is_root(m_nodes.size(), 0);
+
+    for (const int script : m_scripts)
+    {
+        reach(script, reached);
+        is_root[script] = 1;
+    }
+
+    // Only what is still reached is kept, renumbered to close the gaps.
+    std::vector<int> renumbered(m_nodes.size(), -1);
+    int count = 0;
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        if (reached[i]) renumbered[i] = count++;
+    }
+
+    // Written under a name of its own and renamed into place, so an interrupted save leaves the old graph.
+    std::filesystem::path temp_path = m_path;
+    temp_path += ".tmp";
+
+    FILE* file = fopen(temp_path.string().c_str(), "wb");
+    if (!file) return false;
+
+    bool written = fprintf(file, "nwtrees-deps %d %llu\n", graph_version, (unsigned long long)m_config) > 0;
+
+    for (size_t i = 0; written && i < m_nodes.size(); ++i)
+    {
+        if (!reached[i]) continue;
+
+        const Node& node = m_nodes[i];
+        written = fprintf(file, "f %llu %lld %llu %d %d %s\n", (unsigned long long)node.size, (long long)node.time,
+            (unsigned long long)node.hash, is_root[i] && node.script, is_root[i] && node.failed, node.path.c_str()) > 0;
+    }
+
+    for (size_t i = 0; written && i < m_nodes.size(); ++i)
+    {
+        if (!reached[i]) continue;
+
+        for (const Include& include : m_nodes[i].includes)
+        {
+            written = written && fprintf(file, "i %d %d %s\n", renumbered[i], include.target >= 0 ? renumbered[include.target] : -1, include.name.c_str()) > 0;
+        }
+    }
+
+    written = fclose(file) == 0 && written;
+
+    std::error_code error;
+    if (written) std::filesystem::rename(temp_path, m_path, error);
+    if (!written || error) std::filesystem::remove(temp_path, error);
+    return written && !error;
+}
+
+std::vector<char> DependencyGraph::affected(const std::vector<std::filesystem::path>& scripts, const std::vector<std::filesystem::path>& include_dirs)
+{
+    std::vector<char> changed(m_nodes.size(), 0);
+
+    // -- A file changed if it can't be read, or its contents hash differently. The hash is only needed if its size or time moved.
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        Node& node = m_nodes[i];
+
+        std::error_code error;
+        const uint64_t size = std::filesystem::file_size(node.path, error);
+        const int64_t time = error ? 0 : write_time(node.path, error);
+
+        if (error)
+        {
+            changed[i] = 1;
+            continue;
+        }
+
+        if (size == node.size && time == node.time) continue;
+
+        SourceFile source;
+        changed[i] = !source.open(node.path.c_str()) || source.size() != node.size || nwtrees::hash::xxh64(source.view()) != node.hash;
+
+        // Touched but the same: next time, the stat will do.
+        if (!changed[i]) node.time = time;
+    }
+
+    // -- So did the file doing the including, if an include would now find something else, or something where it found nothing.
+
+    std::unordered_map<std::string, std::string> located; // by directory and name
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const Node& node = m_nodes[i];
+        const std::filesystem::path from_dir = std::filesystem::path(node.path).parent_path();
+
+        for (const Include& include : node.includes)
+        {
+            const std::string key = from_dir.string() + '\n' + include.name;
+            auto it = located.find(key);
+
+            if (it == std::end(located))
+            {
+                const std::filesystem::path path = IncludeCache::locate(include.name, from_dir, include_dirs);
+                it = located.emplace(key, path.empty() ? std::string() : normalise(path)).first;
+            }
+
+            const std::string_view target = include.target >= 0 ? std::string_view(m_nodes[include.target].path) : std::string_view();
+            if (it->second != target) changed[i] = 1;
+        }
+    }
+
+    // -- Everything that includes a changed file, however indirectly, is affected by it.
+
+    std::vector<std::vector<int>> includers(m_nodes.size());
+
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        for (const Include& include : m_nodes[i].includes)
+        {
+            if (include.target >= 0) includers[include.target].push_back((int)i);
+        }
+    }
+
+    std::vector<int> pending;
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        if (changed[i]) pending.push_back((int)i);
+    }
+
+    while (!pending.empty())
+    {
+        const int idx = pending.back();
+        pending.pop_back();
+
+        for (const int includer : includers[idx])
+        {
+            if (changed[includer]) continue;
+            changed[includer] = 1;
+            pending.push_back(includer);
+        }
+    }
+
+    std::vector<char> result(scripts.size(), 1);
+    m_scripts.clear();
+
+    for (size_t i = 0; i < scripts.size(); ++i)
+    {
+        const auto it = m_by_path.find(normalise(scripts[i]));
+        if (it == std::end(m_by_path)) continue;
+
+        const Node& node = m_nodes[it->second];
+        result[i] = !node.script || node.failed || changed[it->second];
+        m_scripts.push_back(it->second);
+    }
+
+    return result;
+}
+
+std::vector<std::filesystem::path> DependencyGraph::build_order(const std::vector<std::filesystem::path>& scripts, const std::vector<char>& affected) const
+{
+    std::vector<std::filesystem::path> order;
+
+    // 0 unseen, 1 on the stack, 2 done. A file is emitted once the last of its includes is.
+    std::vector<char> state(m_nodes.size(), 0);
+    std::vector<std::pair<int, size_t>> stack; // node, and the next of its includes to visit
+
+    for (size_t i = 0; i < scripts.size(); ++i)
+    {
+        if (!affected[i]) continue;
+
+        const auto it = m_by_path.find(normalise(scripts[i]));
+        if (it == std::end(m_by_path) || state[it->second]) continue;
+
+        state[it->second] = 1;
+        stack.emplace_back(it->second, 0);
+
+        while (!stack.empty())
+        {
+            auto& [idx, next] = stack.back();
+            const std::vector<Include>& includes = m_nodes[idx].includes;
+
+            if (next < includes.size())
+            {
+                const int target = includes[next++].target;
+
+                if (target >= 0 && !state[target])
+                {
+                    state[target] = 1;
+                    stack.emplace_back(target, 0);
+                }
+
+                continue;
+            }
+
+            state[idx] = 2;
+            order.emplace_back(m_nodes[idx].path);
+            stack.pop_back();
+        }
+    }
+
+    return order;
+}
+
+void DependencyGraph::record_include(const std::filesystem::path& from, const std::string_view name, const std::filesystem::path* to)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const int from_idx = node(from);
+    const int target = to ? node(*to) : -1;
+
+    Node& node = m_nodes[from_idx];
+
+    if (!node.recorded)
+    {
+        node.includes.clear();
+        node.recorded = true;
+    }
+
+    // Every translation unit that reads the file reports its includes again.
+    for (Include& include : node.includes)
+    {
+        if (include.name != name) continue;
+        include.target = target;
+        return;
+    }
+
+    node.includes.push_back({ std::string(name), target });
+}
+
+void DependencyGraph::record_file(const std::filesystem::path& path, const std::string_view source)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Node& node = m_nodes[this->node(path)];
+
+    // A file that includes nothing this run reported nothing, and nothing it included before still counts.
+    if (!node.recorded)
+    {
+        node.includes.clear();
+        node.recorded = true;
+    }
+
+    std::error_code error;
+    node.size = source.size();
+    node.time = write_time(node.path, error);
+    node.hash = nwtrees::hash::xxh64(source);
+}
+
+void DependencyGraph::record_script(const std::filesystem::path& script, const bool failed)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const int idx = node(script);
+    m_nodes[idx].script = true;
+    m_nodes[idx].failed = failed;
+    m_scripts.push_back(idx);
+}
+
+int DependencyGraph::node(const std::filesystem::path& path)
+{
+    std::string key = normalise(path);
+
+    const auto it = m_by_path.find(key);
+    if (it != std::end(m_by_path)) return it->second;
+
+    const int idx = (int)m_nodes.size();
+    m_nodes.emplace_back().path = key;
+    m_by_path.emplace(std::move(key), idx);
+    return idx;
+}
+
+void DependencyGraph::reach(const int idx, std::vector<char>& reached) const
+{
+    if (reached[idx]) return;
+    reached[idx] = 1;
+
+    std::vector<int> pending = { idx };
+
+    while (!pending.empty())
+    {
+        const int next = pending.back();
+        pending.pop_back();
+
+        for (const Include& include : m_nodes[next].includes)
+        {
+            if (include.target < 0 || reached[include.target]) continue;
+            reached[include.target] = 1;
+            pending.push_back(include.target);
+        }
+    }
+}
+
+namespace
+{
+    // As the include cache keys its files.
+    std::string normalise(const std::filesystem::path& path)
+    {
+        std::error_code error;
+        std::filesystem::path absolute = std::filesystem::absolute(path, error);
+        if (error) absolute = path;
+        return absolute.lexically_normal().string();
+    }
+
+    // Splits off the text up to the next space. What's left of line starts after it.
+    bool next_field(std::string_view& line, std::string_view* field)
+    {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.empty()) return false;
+
+        const size_t space = line.find(' ');
+        *field = line.substr(0, space);
+        line = space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
+        return !field->empty();
+    }
+
+    template <typename T>
+    bool parse(const std::string_view field, T* value)
+    {
+        const std::from_chars_result result = std::from_chars(field.data(), field.data() + field.size(), *value);
+        return result.ec == std::errc() && result.ptr == field.data() + field.size();
+    }
+
+    int64_t write_time(const std::filesystem::path& path, std::error_code& error)
+    {
+        return (int64_t)std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Which file includes which, as of the last --preprocess build, kept on disk between runs. With it, a build works out
+// which scripts a change could affect, and builds only those: a script is affected if anything it includes, directly
+// or not, changed, was removed, or would now be found somewhere else. Files are compared by size and modification
+// time first, and only hashed when those differ, so an up-to-date tree costs a stat per file.
+// The record_ members are safe to call from several threads at once; nothing else is.
+class DependencyGraph
+{
+public:
+    // Keeps the graph in the file at path. config covers whatever else decides what a build finds (the include
+    // directories, the lexer), and a graph saved with a different one is thrown away.
+    DependencyGraph(std::filesystem::path path, uint64_t config);
+
+    // Reads the graph saved at path. Returns false if there is none, or it is stale; it is then empty, and every script is affected.
+    bool load();
+
+    // Writes out everything recorded, keeping only what the scripts passed to the last affected() still reach.
+    bool save() const;
+
+    // Which of scripts have to be built, one flag per script: any not built before, any that failed, and any that
+    // reach a file that changed. include_dirs are searched as the include cache searches them.
+    std::vector<char> affected(const std::vector<std::filesystem::path>& scripts, const std::vector<std::filesystem::path>& include_dirs);
+
+    // Every file that the affected scripts are known to reach, each one after all of those it includes, so that lexing
+    // them in order over a pool has the shared, most included files done first. Cycles are broken anywhere.
+    std::vector<std::filesystem::path> build_order(const std::vector<std::filesystem::path>& scripts, const std::vector<char>& affected) const;
+
+    // What building a script found: first, every #include in every file it read, and what that found (to is null if nothing) ...
+    void record_include(const std::filesystem::path& from, std::string_view name, const std::filesystem::path* to);
+
+    // ... then each file read, as it was read, once all of its includes are recorded ...
+    void record_file(const std::filesystem::path& path, std::string_view source);
+
+    // ... and last, the script itself.
+    void record_script(const std::filesystem::path& script, bool failed);
+
+private:
+    struct Include
+    {
+        std::string name;
+        int target; // -1 if the include found nothing
+    };
+
+    struct Node
+    {
+        std::string path; // absolute and normalised
+        uint64_t size = 0;
+        int64_t time = 0;
+        uint64_t hash = 0;
+        std::vector<Include> includes;
+
+        bool script = false;
+        bool failed = false;
+
+        // Whether includes has been replaced with this run's yet.
+        bool recorded = false;
+    };
+
+    int node(const std::filesystem::path& path);
+    void reach(int idx, std::vector<char>& reached) const;
+
+    std::filesystem::path m_path;
+    uint64_t m_config;
+
+    std::mutex m_mutex;
+    std::vector<Node> m_nodes;
+    std::unordered_map<std::string, int> m_by_path;
+
+    // The scripts passed to affected(), which save() keeps everything reachable from.
+    std::vector<int> m_scripts;
+};
@@ -0,0 +1,476 @@
+#include "FileReader.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <Windows.h>
+#else
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+
+    #if defined(__linux__)
+        #include <linux/io_uring.h>
+        #include <string.h>
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+namespace
+{
+    // The most asked of any one read; the rest of a larger file is asked for once that is done.
+    static constexpr size_t max_read = 1u << 30;
+}
+
+// Each backend reads into slots, one per buffer: open() a file into a slot, submit() reads of it, and wait() for them
+// to finish, in whatever order they do. A wait() result is the bytes read, 0 at the end of the file, or negative on an error.
+
+#if defined(_WIN32)
+
+// Overlapped reads, all completing to one port.
+struct FileReader::State
+{
+    HANDLE port;
+    std::vector<HANDLE> files;
+    std::vector<OVERLAPPED> overlapped;
+
+    explicit State(const int slots)
+        : port(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1)),
+          files(slots, INVALID_HANDLE_VALUE),
+          overlapped(slots)
+    {
+    }
+
+    ~State()
+    {
+        if (port) CloseHandle(port);
+    }
+
+    bool open(const int slot, const std::filesystem::path& path, size_t* size)
+    {
+        files[slot] = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (files[slot] == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER file_size;
+        if (!port || !GetFileSizeEx(files[slot], &file_size) || !CreateIoCompletionPort(files[slot], port, (ULONG_PTR)slot, 0))
+        {
+            close(slot);
+            return false;
+        }
+
+        *size = (size_t)file_size.QuadPart;
+        return true;
+    }
+
+    bool submit(const int slot, char* data, const size_t offset, const size_t length)
+    {
+        OVERLAPPED& request = overlapped[slot];
+        request = {};
+        request.Offset = (DWORD)offset;
+        request.OffsetHigh = (DWORD)((uint64_t)offset >> 32);
+
+        return ReadFile(files[slot], data, (DWORD)length, nullptr, &request) || GetLastError() == ERROR_IO_PENDING;
+    }
+
+    bool wait(int* slot, int64_t* result)
+    {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* request = nullptr;
+
+        const BOOL ok = GetQueuedCompletionStatus(port, &bytes, &key, &request, INFINITE);
+        if (!request) return false;
+
+        *slot = (int)key;
+        *result = ok ? (int64_t)bytes : GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        return true;
+    }
+
+    void close(const int slot)
+    {
+        CloseHandle(files[slot]);
+        files[slot] = INVALID_HANDLE_VALUE;
+    }
+};
+
+#else
+
+// io_uring on Linux, driven through the raw system calls. Where it isn't available (an old or locked-down kernel),
+// and on other systems, each read is done on the spot, and its result queued for wait() to hand back.
+struct FileReader::State
+{
+    std::vector<int> fds;
+    std::vector<char*> data;
+    std::vector<size_t> offsets;
+    std::vector<size_t> lengths;
+    std::deque<std::pair<int, int64_t>> completed; // by blocking reads
+
+    explicit State(const int slots)
+        : fds(slots, -1),
+          data(slots, nullptr),
+          offsets(slots, 0),
+          lengths(slots, 0)
+    {
+        start_ring(slots);
+    }
+
+    ~State()
+    {
+        stop_ring();
+    }
+
+    bool open(const int slot, const std::filesystem::path& path, size_t* size)
+    {
+        fds[slot] = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fds[slot] < 0) return false;
+
+        struct stat info;
+        if (fstat(fds[slot], &info) != 0)
+        {
+            close(slot);
+            return false;
+        }
+
+        *size = (size_t)info.st_size;
+        return true;
+    }
+
+    bool submit(const int slot, char* buffer, const size_t offset, const size_t length)
+    {
+        data[slot] = buffer;
+        offsets[slot] = offset;
+        lengths[slot] = length;
+
+        if (submit_ring(slot)) return true;
+
+        completed.emplace_back(slot, read_now(slot));
+        return true;
+    }
+
+    bool wait(int* slot, int64_t* result)
+    {
+        if (!completed.empty())
+        {
+            *slot = completed.front().first;
+            *result = completed.front().second;
+            completed.pop_front();
+            return true;
+        }
+
+        if (!wait_ring(slot, result)) return false;
+
+        // A kernel with io_uring but not its plain read op; finish this one, and every one after it, without.
+        if (*result == -EINVAL)
+        {
+            ring_reads = false;
+            *result = read_now(*slot);
+        }
+
+        return true;
+    }
+
+    void close(const int slot)
+    {
+        ::close(fds[slot]);
+        fds[slot] = -1;
+    }
+
+    int64_t read_now(const int slot)
+    {
+        while (true)
+        {
+            const ssize_t bytes = pread(fds[slot], data[slot], lengths[slot], (off_t)offsets[slot]);
+            if (bytes >= 0 || errno != EINTR) return bytes >= 0 ? bytes : -errno;
+        }
+    }
+
+#if defined(__linux__)
+    int ring = -1;
+    bool ring_reads = true;
+    int ring_pending = 0;
+    void* sq_ring = MAP_FAILED;
+    void* cq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+    size_t sqes_size = 0;
+
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+    void start_ring(const int slots)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        ring = (int)syscall(__NR_io_uring_setup, (unsigned)slots, &params);
+        if (ring < 0) return;
+
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+        sqes = (io_uring_sqe*)mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+
+        if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            stop_ring();
+            return;
+        }
+
+        char* sq = (char*)sq_ring;
+        char* cq = (char*)cq_ring;
+        sq_tail = (unsigned*)(sq + params.sq_off.tail);
+        sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + params.sq_off.array);
+        cq_head = (unsigned*)(cq + params.cq_off.head);
+        cq_tail = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+    }
+
+    void stop_ring()
+    {
+        if (sqes != MAP_FAILED) munmap(sqes, sqes_size);
+        if (cq_ring != MAP_FAILED) munmap(cq_ring, cq_ring_size);
+        if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_size);
+        if (ring >= 0) ::close(ring);
+
+        ring = -1;
+        sq_ring = cq_ring = MAP_FAILED;
+        sqes = (io_uring_sqe*)MAP_FAILED;
+    }
+
+    // There is a slot in the ring for every buffer, so it can never be full.
+    bool submit_ring(const int slot)
+    {
+        if (ring < 0 || !ring_reads) return false;
+
+        const unsigned tail = *sq_tail;
+        const unsigned index = tail & *sq_mask;
+
+        io_uring_sqe& sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fds[slot];
+        sqe.off = offsets[slot];
+        sqe.addr = (uint64_t)(uintptr_t)data[slot];
+        sqe.len = (unsigned)lengths[slot];
+        sqe.user_data = (uint64_t)slot;
+
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        while (syscall(__NR_io_uring_enter, ring, 1u, 0u, 0u, nullptr, 0) < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN) continue;
+
+            // Take it back off the ring, and let the caller read it some other way.
+            __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        ++ring_pending;
+        return true;
+    }
+
+    bool wait_ring(int* slot, int64_t* result)
+    {
+        if (ring < 0 || ring_pending == 0) return false;
+
+        while (true)
+        {
+            const unsigned head = *cq_head;
+
+            if (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+            {
+                const io_uring_cqe& cqe = cqes[head & *cq_mask];
+                *slot = (int)cqe.user_data;
+                *result = cqe.res;
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                --ring_pending;
+                return true;
+            }
+
+            if (syscall(__NR_io_uring_enter, ring, 0u, 1u, (unsigned)IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) return false;
+        }
+    }
+#else
+    bool ring_reads = false;
+
+    void start_ring(int) { }
+    void stop_ring() { }
+    bool submit_ring(int) { return false; }
+    bool wait_ring(int*, int64_t*) { return false; }
+#endif
+};
+
+#endif
+
+FileReader::FileReader(std::vector<std::filesystem::path> paths, const int buffer_count)
+    : m_paths(std::move(paths)),
+      m_buffers(std::max(buffer_count, 1)),
+      m_state(std::make_unique<State>((int)m_buffers.size()))
+{
+    for (int i = (int)m_buffers.size() - 1; i >= 0; --i) m_free_buffers.push_back(i);
+    m_thread = std::thread([this]() { run(); });
+}
+
+FileReader::~FileReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+
+    m_buffer_free.notify_all();
+    m_thread.join();
+}
+
+bool FileReader::next(File* file)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // Counted before waiting, so that callers waiting together never outnumber the files left.
+    if (m_handed_out == m_paths.size()) return false;
+    ++m_handed_out;
+
+    m_file_ready.wait(lock, [this]() { return !m_ready.empty(); });
+
+    *file = m_ready.front();
+    m_ready.pop_front();
+    return true;
+}
+
+void FileReader::release(const File& file)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free_buffers.push_back(file.buffer);
+    }
+
+    m_buffer_free.notify_one();
+}
+
+void FileReader::run()
+{
+    struct Read
+    {
+        int idx;
+        size_t size;
+        size_t done;
+        std::chrono::high_resolution_clock::time_point begin;
+    };
+
+    std::vector<Read> reads(m_buffers.size()); // by buffer
+    std::vector<char> in_flight(m_buffers.size(), 0);
+    int in_flight_count = 0;
+    size_t next = 0;
+
+    const auto submit = [&](const int buffer)
+    {
+        const Read& read = reads[buffer];
+        return m_state->submit(buffer, m_buffers[buffer].data() + read.done, read.done, std::min(read.size - read.done, max_read));
+    };
+
+    while (true)
+    {
+        // -- Start reading as many files as there are buffers for. Only wait for one if there is nothing else to do.
+
+        while (next < m_paths.size())
+        {
+            const int buffer = take_buffer(in_flight_count == 0);
+            if (buffer < 0) break;
+
+            Read& read = reads[buffer];
+            read = { (int)next++, 0, 0, std::chrono::high_resolution_clock::now() };
+
+            if (!m_state->open(buffer, m_paths[read.idx], &read.size))
+            {
+                deliver(read.idx, buffer, 0, false, read.begin);
+                continue;
+            }
+
+            m_buffers[buffer].resize(read.size);
+
+            if (read.size == 0 || !submit(buffer))
+            {
+                m_state->close(buffer);
+                deliver(read.idx, buffer, 0, read.size == 0, read.begin);
+                continue;
+            }
+
+            in_flight[buffer] = 1;
+            ++in_flight_count;
+        }
+
+        if (in_flight_count == 0) break;
+
+        // -- Collect one read, and ask for the rest of its file if there is more.
+
+        int buffer;
+        int64_t result;
+
+        if (!m_state->wait(&buffer, &result))
+        {
+            // Nothing more will complete, so everything still in flight has failed.
+            for (size_t i = 0; i < in_flight.size(); ++i)
+            {
+                if (!in_flight[i]) continue;
+                m_state->close((int)i);
+                deliver(reads[i].idx, (int)i, 0, false, reads[i].begin);
+            }
+
+            next = m_paths.size();
+            in_flight_count = 0;
+            continue;
+        }
+
+        Read& read = reads[buffer];
+        if (result > 0) read.done += (size_t)result;
+        if (result > 0 && read.done < read.size && submit(buffer)) continue;
+
+        // Done, failed, or cut short because the file shrank since it was opened; what was read is what there is.
+        in_flight[buffer] = 0;
+        --in_flight_count;
+        m_state->close(buffer);
+        deliver(read.idx, buffer, read.done, result == 0 || (result > 0 && read.done == read.size), read.begin);
+    }
+}
+
+int FileReader::take_buffer(const bool wait)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (wait) m_buffer_free.wait(lock, [this]() { return m_stopping || !m_free_buffers.empty(); });
+    if (m_stopping || m_free_buffers.empty()) return -1;
+
+    const int buffer = m_free_buffers.back();
+    m_free_buffers.pop_back();
+    return buffer;
+}
+
+void FileReader::deliver(const int idx, const int buffer, const size_t size, const bool read, const std::chrono::high_resolution_clock::time_point begin)
+{
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ready.push_back({ idx, read ? std::string_view(m_buffers[buffer].data(), size) : std::string_view(), read, begin, end, buffer });
+    }
+
+    m_file_ready.notify_one();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Reads a list of files on a thread of its own, ahead of whoever is consuming them, so that waiting on the disk
+// (or the network share) overlaps with lexing. Several reads are kept in flight at once: io_uring on Linux, overlapped
+// reads on Windows, and elsewhere one blocking read at a time. Files are read into a fixed set of buffers that are
+// reused as they are released, so however many files there are, only buffer_count are ever held in memory.
+// next() and release() are safe to call from several threads at once.
+class FileReader
+{
+public:
+    struct File
+    {
+        int idx; // into the paths given
+        std::string_view data;
+        bool read; // false if the file couldn't be read; data is empty then
+
+        // From opening the file to having all of it.
+        std::chrono::high_resolution_clock::time_point read_begin;
+        std::chrono::high_resolution_clock::time_point read_end;
+
+        int buffer;
+    };
+
+    // Starts reading paths, in order.
+    FileReader(std::vector<std::filesystem::path> paths, int buffer_count);
+    ~FileReader();
+
+    FileReader(const FileReader&) = delete;
+    FileReader& operator=(const FileReader&) = delete;
+
+    // Blocks until another file has been read, in whatever order they finish. Returns false once every file has been handed out.
+    bool next(File* file);
+
+    // Hands file's buffer back, to be read into again. Every file next() gives out must be released.
+    void release(const File& file);
+
+private:
+    struct State;
+
+    void run();
+    int take_buffer(bool wait);
+    void deliver(int idx, int buffer, size_t size, bool read, std::chrono::high_resolution_clock::time_point begin);
+
+    std::vector<std::filesystem::path> m_paths;
+    std::vector<std::vector<char>> m_buffers;
+    std::unique_ptr<State> m_state;
+
+    std::mutex m_mutex;
+    std::condition_variable m_buffer_free;
+    std::condition_variable m_file_ready;
+    std::vector<int> m_free_buffers;
+    std::deque<File> m_ready;
+    size_t m_handed_out = 0;
+    bool m_stopping = false;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,261 @@
+#include "FileWatcher.hpp"
+
+#include <system_error>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <Windows.h>
+#elif defined(__linux__)
+    #include <errno.h>
+    #include <poll.h>
+    #include <sys/inotify.h>
+    #include <unistd.h>
+    #include <unordered_map>
+#else
+    #include <chrono>
+    #include <map>
+    #include <thread>
+#endif
+
+#if defined(_WIN32)
+
+// One read of the whole tree is always outstanding; each wait collects it and starts the next.
+struct FileWatcher::State
+{
+    HANDLE directory = INVALID_HANDLE_VALUE;
+    HANDLE event = nullptr;
+    OVERLAPPED overlapped = {};
+    bool pending = false;
+    alignas(DWORD) char buffer[64 * 1024];
+
+    bool read()
+    {
+        overlapped = {};
+        overlapped.hEvent = event;
+
+        // Writes come as last-write changes, as there is no equivalent of inotify's close-after-write.
+        pending = ReadDirectoryChangesW(directory, buffer, sizeof(buffer), TRUE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &overlapped, nullptr);
+
+        return pending;
+    }
+};
+
+FileWatcher::FileWatcher(std::filesystem::path root)
+    : m_root(std::move(root)),
+      m_state(std::make_unique<State>())
+{
+    m_state->directory = CreateFileW(m_root.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (m_state->directory == INVALID_HANDLE_VALUE) return;
+
+    m_state->event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    if (m_state->event) m_state->read();
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (m_state->pending)
+    {
+        DWORD bytes;
+        CancelIo(m_state->directory);
+        GetOverlappedResult(m_state->directory, &m_state->overlapped, &bytes, TRUE);
+    }
+
+    if (m_state->event) CloseHandle(m_state->event);
+    if (m_state->directory != INVALID_HANDLE_VALUE) CloseHandle(m_state->directory);
+}
+
+bool FileWatcher::valid() const
+{
+    return m_state->pending;
+}
+
+bool FileWatcher::wait(std::vector<std::filesystem::path>& changed, const int timeout_ms)
+{
+    if (!m_state->pending) return false;
+
+    const DWORD result = WaitForSingleObject(m_state->event, timeout_ms < 0 ? INFINITE : (DWORD)timeout_ms);
+    if (result == WAIT_TIMEOUT) return true;
+    if (result != WAIT_OBJECT_0) return false;
+
+    DWORD bytes = 0;
+    m_state->pending = false;
+
+    // Too many changes to fit the buffer are reported as none at all.
+    if (!GetOverlappedResult(m_state->directory, &m_state->overlapped, &bytes, FALSE) || bytes == 0)
+    {
+        changed.push_back(m_root);
+    }
+    else
+    {
+        for (const char* at = m_state->buffer; ; )
+        {
+            const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)at;
+            changed.push_back(m_root / std::wstring(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+
+            if (!info->NextEntryOffset) break;
+            at += info->NextEntryOffset;
+        }
+    }
+
+    ResetEvent(m_state->event);
+    return m_state->read();
+}
+
+#elif defined(__linux__)
+
+// inotify watches single directories, so every directory in the tree gets a watch of its own.
+struct FileWatcher::State
+{
+    int fd = -1;
+    std::unordered_map<int, std::filesystem::path> directories; // by watch descriptor
+
+    void watch_tree(const std::filesystem::path& directory)
+    {
+        // Only finished writes: a file is read as soon as it is reported, and shouldn't be caught halfway.
+        static constexpr uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+
+        const int wd = inotify_add_watch(fd, directory.c_str(), mask | IN_ONLYDIR);
+        if (wd < 0) return;
+        directories[wd] = directory;
+
+        std::error_code error;
+
+        for (std::filesystem::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+        {
+            if (it->is_directory(error) && !it->is_symlink(error)) watch_tree(it->path());
+        }
+    }
+};
+
+FileWatcher::FileWatcher(std::filesystem::path root)
+    : m_root(std::move(root)),
+      m_state(std::make_unique<State>())
+{
+    m_state->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_state->fd >= 0) m_state->watch_tree(m_root);
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (m_state->fd >= 0) close(m_state->fd);
+}
+
+bool FileWatcher::valid() const
+{
+    return m_state->fd >= 0 && !m_state->directories.empty();
+}
+
+bool FileWatcher::wait(std::vector<std::filesystem::path>& changed, const int timeout_ms)
+{
+    pollfd ready = { m_state->fd, POLLIN, 0 };
+    const int count = poll(&ready, 1, timeout_ms);
+    if (count <= 0) return count == 0 || errno == EINTR;
+
+    alignas(inotify_event) char buffer[64 * 1024];
+
+    // Everything queued so far, without waiting for more.
+    while (true)
+    {
+        const ssize_t length = read(m_state->fd, buffer, sizeof(buffer));
+        if (length < 0) return errno == EAGAIN || errno == EINTR;
+
+        for (const char* at = buffer; at < buffer + length; )
+        {
+            const inotify_event* event = (const inotify_event*)at;
+            at += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                changed.push_back(m_root);
+                continue;
+            }
+
+            const auto directory = m_state->directories.find(event->wd);
+            if (directory == std::end(m_state->directories)) continue;
+
+            if (event->mask & IN_IGNORED)
+            {
+                m_state->directories.erase(directory);
+                continue;
+            }
+
+            const bool is_directory = event->mask & IN_ISDIR;
+
+            // A new file is reported once it has been written and closed.
+            if (!event->len || ((event->mask & IN_CREATE) && !is_directory)) continue;
+
+            std::filesystem::path path = directory->second / event->name;
+
+            // Whatever was put in a new directory before it was watched is covered by reporting the directory.
+            if (is_directory && (event->mask & (IN_CREATE | IN_MOVED_TO))) m_state->watch_tree(path);
+
+            changed.push_back(std::move(path));
+        }
+    }
+}
+
+#else
+
+// Without a way to be told, the tree is scanned every so often, and compared with the last scan.
+struct FileWatcher::State
+{
+    std::map<std::filesystem::path, std::filesystem::file_time_type> times;
+    bool scanned = false;
+
+    void scan(const std::filesystem::path& root, std::vector<std::filesystem::path>* changed)
+    {
+        std::map<std::filesystem::path, std::filesystem::file_time_type> now;
+        std::error_code error;
+
+        for (std::filesystem::recursive_directory_iterator it(root, error), end; !error && it != end; it.increment(error))
+        {
+            if (!it->is_regular_file(error)) continue;
+
+            const std::filesystem::file_time_type time = it->last_write_time(error);
+            const auto before = times.find(it->path());
+            if (changed && (before == std::end(times) || before->second != time)) changed->push_back(it->path());
+            now.emplace(it->path(), time);
+        }
+
+        for (const auto& [path, _] : times)
+        {
+            if (changed && !now.count(path)) changed->push_back(path);
+        }
+
+        times = std::move(now);
+        scanned = !error;
+    }
+};
+
+FileWatcher::FileWatcher(std::filesystem::path root)
+    : m_root(std::move(root)),
+      m_state(std::make_unique<State>())
+{
+    m_state->scan(m_root, nullptr);
+}
+
+FileWatcher::~FileWatcher() = default;
+
+bool FileWatcher::valid() const
+{
+    return m_state->scanned;
+}
+
+bool FileWatcher::wait(std::vector<std::filesystem::path>& changed, const int timeout_ms)
+{
+    static constexpr std::chrono::milliseconds interval(50);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    const size_t count = changed.size();
+
+    while (true)
+    {
+        m_state->scan(m_root, &changed);
+        if (changed.size() != count || (timeout_ms >= 0 && std::chrono::steady_clock::now() >= deadline)) return true;
+        std::this_thread::sleep_for(interval);
+    }
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+// Reports changes to the files under a directory, as they happen: inotify on Linux, ReadDirectoryChangesW on Windows,
+// and elsewhere, a poll of modification times. Only call it from one thread.
+class FileWatcher
+{
+public:
+    // Starts watching root and everything under it, including directories created later. Check valid() afterwards.
+    explicit FileWatcher(std::filesystem::path root);
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    bool valid() const;
+
+    // Blocks until something changes or timeout_ms passes (negative waits for good), then adds to changed every path
+    // written, created, renamed or removed since the last call. A directory in the list means anything under it may
+    // have changed, as when one is moved in, or the system dropped events; it's then up to the caller to look.
+    // Returns false if watching failed. A path can be reported more than once.
+    bool wait(std::vector<std::filesystem::path>& changed, int timeout_ms);
+
+private:
+    struct State;
+
+    std::filesystem::path m_root;
+    std::unique_ptr<State> m_state;
+};
@@ -0,0 +1,166 @@
+#include "IncludeCache.hpp"
+#include "TokenCache.hpp"
+#include "Trace.hpp"
+#include "WorkPool.hpp"
+
+#include <nwtrees/Snapshot.hpp>
+
+#include <system_error>
+
+struct IncludeCache::Entry
+{
+    std::once_flag once;
+    File file;
+};
+
+IncludeCache::IncludeCache(std::vector<std::filesystem::path> include_dirs, const nwtrees::LexerOptions& options, const TokenCache* token_cache,
+    const bool collect_stats, const bool count_cycles, Trace* const trace, WorkPool* const pool)
+    : m_include_dirs(std::move(include_dirs)),
+      m_options(options),
+      m_token_cache(token_cache),
+      m_collect_stats(collect_stats),
+      m_count_cycles(count_cycles),
+      m_trace(trace),
+      m_pool(pool)
+{
+    // The preprocessor needs the directives, and reads names through LexerOutput::text.
+    // Files stay mapped for as long as their output is around, so names can be left where they are.
+    m_options.directives = true;
+    m_options.intern_names = false;
+    m_options.source_names = true;
+    m_options.layout = nwtrees::TokenLayout::Structs;
+}
+
+IncludeCache::~IncludeCache() = default;
+
+const IncludeCache::File* IncludeCache::load(const std::filesystem::path& path)
+{
+    Entry& loaded = entry(path);
+
+    // Whoever gets here first lexes the file; everyone else waits for them, then shares the result.
+    std::call_once(loaded.once, [&]()
+    {
+        File& file = loaded.file;
+        file.path = path;
+        file.name = path.string();
+
+        const Trace::Clock::time_point read_begin = Trace::Clock::now();
+        if (!file.source.open(file.name.c_str())) return;
+        const Trace::Clock::time_point lex_begin = Trace::Clock::now();
+
+        nwtrees::LexedFile& lexed = file.lexed;
+        lexed.name = file.name;
+        lexed.source = file.source.view();
+
+        const uint64_t cache_key = m_token_cache ? TokenCache::key(lexed.source, m_options) : 0;
+        const nwtrees::LexerSnapshot* snapshot = nwtrees::nwscript_snapshot();
+
+        // Names come from the snapshot rather than the mapped file, but the preprocessor reads them the same either way.
+        if (snapshot && path.filename() == snapshot->name && nwtrees::load_snapshot(*snapshot, lexed.source, lexed.output, m_options))
+        {
+            file.from_snapshot = true;
+        }
+        else if (m_token_cache && m_token_cache->load(cache_key, lexed.source, lexed.output, m_options))
+        {
+            file.from_token_cache = true;
+        }
+        else
+        {
+            if (m_collect_stats)
+            {
+                file.stats.count_cycles = m_count_cycles;
+                lexed.output = nwtrees::lexer(lexed.source, std::move(lexed.output), m_options, file.stats);
+            }
+            else
+            {
+                nwtrees::LexerOptions options = m_options;
+                const int lent = m_pool ? m_pool->borrow(nwtrees::chunk_count(lexed.source.size(), m_options) - 1) : 0;
+                options.threads = 1 + lent;
+
+                lexed.output = m_options.recover ? nwtrees::lexer(lexed.source, std::move(lexed.output), options) :
+                    nwtrees::lexer<nwtrees::CompileLexerConfig>(lexed.source, std::move(lexed.output), options);
+
+                if (m_pool) m_pool->give_back(lent);
+            }
+            if (m_token_cache) m_token_cache->store(cache_key, lexed.source, lexed.output, m_options);
+        }
+
+        if (m_trace)
+        {
+            const int track = m_trace->thread_track();
+            const char* const from = file.from_snapshot ? "snapshot" : file.from_token_cache ? "token cache" : nullptr;
+            m_trace->add({ "read", track, read_begin, lex_begin, file.name, lexed.source.size() });
+            m_trace->add({ "lex", track, lex_begin, Trace::Clock::now(), file.name, lexed.source.size(), lexed.output.tokens.size(), from });
+        }
+
+        file.loaded = true;
+    });
+
+    return loaded.file.loaded ? &loaded.file : nullptr;
+}
+
+const IncludeCache::File* IncludeCache::find(const std::string_view name, const nwtrees::LexedFile& from)
+{
+    // Every file here is named after its path.
+    const std::filesystem::path from_dir = std::filesystem::path(from.name).parent_path();
+    const std::string key = from_dir.string() + '\n' + std::string(name);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto it = m_resolved.find(key);
+        if (it != std::end(m_resolved)) return it->second;
+    }
+
+    const std::filesystem::path path = locate(name, from_dir, m_include_dirs);
+    const File* found = path.empty() ? nullptr : load(path);
+
+    // Two threads resolving the same name at once find the same file, so it doesn't matter whose result is kept.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resolved.emplace(key, found);
+    return found;
+}
+
+std::filesystem::path IncludeCache::locate(const std::string_view name, const std::filesystem::path& from_dir,
+    const std::vector<std::filesystem::path>& include_dirs)
+{
+    std::filesystem::path file_name(name);
+    file_name += ".nss";
+
+    std::error_code error;
+    if (std::filesystem::is_regular_file(from_dir / file_name, error)) return from_dir / file_name;
+
+    for (const std::filesystem::path& dir : include_dirs)
+    {
+        if (std::filesystem::is_regular_file(dir / file_name, error)) return dir / file_name;
+    }
+
+    return {};
+}
+
+std::vector<const IncludeCache::File*> IncludeCache::files() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::vector<const File*> files;
+
+    for (const auto& [_, entry] : m_entries)
+    {
+        if (entry->file.loaded) files.push_back(&entry->file);
+    }
+
+    return files;
+}
+
+IncludeCache::Entry& IncludeCache::entry(const std::filesystem::path& path)
+{
+    std::error_code error;
+    std::filesystem::path absolute = std::filesystem::absolute(path, error);
+    if (error) absolute = path;
+
+    const std::string key = absolute.lexically_normal().string();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::unique_ptr<Entry>& slot = m_entries[key];
+    if (!slot) slot = std::make_unique<Entry>();
+    return *slot;
+}
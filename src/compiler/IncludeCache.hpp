@@ -0,0 +1,78 @@
+#pragma once
+
+#include "SourceFile.hpp"
+
+#include <nwtrees/Preprocessor.hpp>
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class TokenCache;
+class Trace;
+class WorkPool;
+
+// Every file lexed during a build, each lexed once however many translation units include it.
+// Files stay mapped and lexed until the cache is destroyed, and are never changed after they are lexed,
+// so translation units on any thread can share them. All members are safe to call from several threads at once;
+// two threads asking for the same file get the same one, with one lexing it while the other waits.
+class IncludeCache
+{
+public:
+    struct File
+    {
+        std::filesystem::path path;
+        std::string name;
+        SourceFile source;
+        nwtrees::LexedFile lexed;
+
+        // False if the file couldn't be read. A file that lexed with errors is still loaded.
+        bool loaded = false;
+        bool from_token_cache = false;
+        bool from_snapshot = false; // the library's built-in nwscript.nss
+
+        // How lexing this file went, if the cache collects stats and the file wasn't in the token cache.
+        nwtrees::LexerStats stats;
+    };
+
+    // Includes are looked for next to the file including them, then in each of include_dirs in order.
+    // token_cache, trace and pool may be null; if not, they must outlive the include cache. Each file read and lexed goes in
+    // trace. A file large enough to split across options.threads borrows them from pool, and is lexed whole without one.
+    IncludeCache(std::vector<std::filesystem::path> include_dirs, const nwtrees::LexerOptions& options, const TokenCache* token_cache,
+        bool collect_stats = false, bool count_cycles = false, Trace* trace = nullptr, WorkPool* pool = nullptr);
+    ~IncludeCache();
+
+    // The file at path, lexed. Returns null if it can't be read.
+    const File* load(const std::filesystem::path& path);
+
+    // The file an #include "name" in from refers to: name.nss, next to from or in an include directory. Null if there is none.
+    const File* find(std::string_view name, const nwtrees::LexedFile& from);
+
+    // Where an #include "name" in a file in from_dir finds its file, by the rule find() uses; empty if nowhere.
+    static std::filesystem::path locate(std::string_view name, const std::filesystem::path& from_dir,
+        const std::vector<std::filesystem::path>& include_dirs);
+
+    // Every file loaded so far, in no particular order. Only call this once nothing else is using the cache.
+    std::vector<const File*> files() const;
+
+private:
+    struct Entry;
+
+    Entry& entry(const std::filesystem::path& path);
+
+    std::vector<std::filesystem::path> m_include_dirs;
+    nwtrees::LexerOptions m_options;
+    const TokenCache* m_token_cache;
+    bool m_collect_stats;
+    bool m_count_cycles;
+    Trace* m_trace;
+    WorkPool* m_pool;
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> m_entries; // by normalised absolute path
+    std::unordered_map<std::string, const File*> m_resolved; // by including directory and include name
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// A read-only view of a file's contents, mapped straight from the page cache (mmap / MapViewOfFile).
+// Nothing is copied, and the view is not NUL-terminated; pass it to the length-bounded lexer overload.
+class SourceFile
+{
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Maps path, releasing whatever was mapped before. Returns false if the file can't be opened or mapped.
+    bool open(const char* path);
+    void close();
+
+    std::string_view view() const { return { m_data, m_size }; }
+    size_t size() const { return m_size; }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+
+#if defined(_WIN32)
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,159 @@
+#include "TokenCache.hpp"
+
+#include <nwtrees/util/Hash.hpp>
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <system_error>
+#include <thread>
+
+namespace
+{
+    static constexpr uint32_t cache_magic = 0x4B545754; // "TWTK"
+
+    // Followed by the tokens, then their offsets, then the names, then the directives.
+    struct EntryHeader
+    {
+        uint32_t magic;
+        uint32_t lexer_version;
+        uint32_t token_size;
+        uint32_t token_count;
+        uint64_t source_size;
+        uint64_t names_size;
+        uint64_t directive_count;
+
+        // Nonzero if names were left in the source (LexerOptions::source_names), so entries below source_size index it.
+        uint64_t source_names;
+    };
+
+    // Whether output lexed with options is what an entry holds: tokens with their names in the name buffer or the source.
+    bool cacheable(const nwtrees::LexerOptions& options)
+    {
+        return !options.intern_names && options.layout == nwtrees::TokenLayout::Structs;
+    }
+
+    // Straight into the vector's storage; there is nothing to parse.
+    template <typename T>
+    bool read_array(FILE* file, std::pmr::vector<T>& out, const size_t count)
+    {
+        out.resize(count);
+        return fread(out.data(), sizeof(T), count, file) == count;
+    }
+}
+
+TokenCache::TokenCache(std::filesystem::path directory)
+    : m_directory(std::move(directory))
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_directory, error);
+    m_valid = std::filesystem::is_directory(m_directory, error);
+}
+
+uint64_t TokenCache::key(const std::string_view source, const nwtrees::LexerOptions& options)
+{
+    // Recovering makes no difference to output without errors, the only kind stored; recording directives does,
+    // and so does where names are kept.
+    const bool source_names = options.source_names && !options.intern_names;
+    return nwtrees::hash::xxh64(source, (options.directives ? 1 : 0) | (source_names ? 2 : 0));
+}
+
+bool TokenCache::load(const uint64_t key, const std::string_view source, nwtrees::LexerOutput& output, const nwtrees::LexerOptions& options) const
+{
+    if (!cacheable(options)) return false;
+
+    const std::filesystem::path path = entry_path(key);
+
+    std::error_code error;
+    const uintmax_t file_size = std::filesystem::file_size(path, error);
+    if (error) return false;
+
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file) return false;
+
+    EntryHeader header;
+
+    // A different lexer, or a hash collision between two sources of different sizes.
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+        header.magic == cache_magic &&
+        header.lexer_version == nwtrees::lexer_version &&
+        header.token_size == sizeof(nwtrees::Token) &&
+        header.source_size == source.size();
+
+    // A damaged entry, rather than a foreign one, is only caught by its counts: none can be more than the source is long,
+    // and together they must account for the whole of the file. Either way, it is a miss, and nothing is allocated for it.
+    valid = valid && header.token_count <= source.size() && header.names_size <= source.size() && header.directive_count <= source.size() &&
+        file_size == sizeof(header) + header.token_count * (sizeof(nwtrees::Token) + sizeof(int)) + header.names_size +
+            header.directive_count * sizeof(nwtrees::Directive);
+
+    // Read aside, so a miss leaves output as it was.
+    nwtrees::LexerOutput loaded(output.resource());
+    valid = valid && read_array(file, loaded.tokens, header.token_count);
+    valid = valid && read_array(file, loaded.offsets, header.token_count);
+    valid = valid && read_array(file, loaded.names, header.names_size);
+    valid = valid && read_array(file, loaded.directives, header.directive_count);
+
+    fclose(file);
+    if (!valid) return false;
+
+    output.tokens = std::move(loaded.tokens);
+    output.offsets = std::move(loaded.offsets);
+    output.names = std::move(loaded.names);
+    output.directives = std::move(loaded.directives);
+    output.source = header.source_names ? source : std::string_view();
+    output.errors.clear();
+    output.diagnostics.clear();
+    return true;
+}
+
+bool TokenCache::store(const uint64_t key, const std::string_view source, const nwtrees::LexerOutput& output, const nwtrees::LexerOptions& options) const
+{
+    if (!cacheable(options) || !output.errors.empty()) return false;
+
+    const EntryHeader header =
+    {
+        cache_magic,
+        nwtrees::lexer_version,
+        sizeof(nwtrees::Token),
+        (uint32_t)output.tokens.size(),
+        source.size(),
+        output.names.size(),
+        output.directives.size(),
+        !output.source.empty(),
+    };
+
+    // Written under a name of its own and renamed into place, so readers (and other writers of the same entry,
+    // which is the same file in several places) never see it half-written.
+    const std::filesystem::path path = entry_path(key);
+    std::filesystem::path temp_path = path;
+    temp_path += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+        (size_t)std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+
+    FILE* file = fopen(temp_path.string().c_str(), "wb");
+    if (!file) return false;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(output.tokens.data(), sizeof(nwtrees::Token), output.tokens.size(), file) == output.tokens.size();
+    written = written && fwrite(output.offsets.data(), sizeof(int), output.offsets.size(), file) == output.offsets.size();
+    written = written && fwrite(output.names.data(), 1, output.names.size(), file) == output.names.size();
+    written = written && fwrite(output.directives.data(), sizeof(nwtrees::Directive), output.directives.size(), file) == output.directives.size();
+    written = fclose(file) == 0 && written;
+
+    std::error_code error;
+
+    if (written)
+    {
+        std::filesystem::rename(temp_path, path, error);
+        if (!error) return true;
+    }
+
+    std::filesystem::remove(temp_path, error);
+    return false;
+}
+
+std::filesystem::path TokenCache::entry_path(const uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.tok", (unsigned long long)key);
+    return m_directory / name;
+}
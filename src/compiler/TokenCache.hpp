@@ -0,0 +1,38 @@
+#pragma once
+
+#include <nwtrees/Lexer.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+// Lexer output for scripts that have been lexed before, kept on disk between runs.
+// Entries are keyed by a hash of the source (and of the options that change what is stored) alone,
+// so identical files anywhere in the tree share one.
+// Each entry is the tokens, offsets, names and directives written out as they are in memory, so loading one is a copy.
+// Only error-free output is stored. All members are safe to call from several threads at once.
+class TokenCache
+{
+public:
+    // Creates directory if needed. Check valid() afterwards.
+    explicit TokenCache(std::filesystem::path directory);
+
+    bool valid() const { return m_valid; }
+
+    static uint64_t key(std::string_view source, const nwtrees::LexerOptions& options = nwtrees::LexerOptions());
+
+    // Replaces output's tokens, offsets, names and directives with those cached for source. Returns false on a miss,
+    // which leaves output as it was; a damaged entry is a miss. Entries only hold plain names in TokenLayout::Structs,
+    // as load_snapshot's do, so output wanted with intern_names or in another layout always misses.
+    bool load(uint64_t key, std::string_view source, nwtrees::LexerOutput& output, const nwtrees::LexerOptions& options) const;
+
+    // Stores output, the result of lexing source with options. Returns false if the entry could not be written,
+    // or if options are ones load() would never give it back for.
+    bool store(uint64_t key, std::string_view source, const nwtrees::LexerOutput& output, const nwtrees::LexerOptions& options) const;
+
+private:
+    std::filesystem::path entry_path(uint64_t key) const;
+
+    std::filesystem::path m_directory;
+    bool m_valid = false;
+};
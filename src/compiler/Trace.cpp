@@ -0,0 +1,150 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+namespace
+{
+    std::string json_string(std::string_view text);
+    double bytes_per_second(const Trace::Span& span);
+}
+
+Trace::Trace()
+    : m_start(Clock::now())
+{
+}
+
+int Trace::thread_track()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto found = m_threads.find(std::this_thread::get_id());
+    if (found != std::end(m_threads)) return found->second;
+
+    const int track_idx = named_track("thread " + std::to_string(m_threads.size() + 1));
+    m_threads.emplace(std::this_thread::get_id(), track_idx);
+    return track_idx;
+}
+
+int Trace::track(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return named_track(name);
+}
+
+void Trace::add(Span span)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_spans.push_back(std::move(span));
+}
+
+// { "traceEvents": [ ... ] }, with a thread_name event naming each track, then one complete ("X") event per span.
+bool Trace::write(const std::filesystem::path& path) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    FILE* file = fopen(path.string().c_str(), "wb");
+    if (!file) return false;
+
+    const auto micros = [this](const Clock::time_point time) { return std::chrono::duration<double, std::micro>(time - m_start).count(); };
+
+    bool written = fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n") > 0;
+    bool first = true;
+
+    for (size_t i = 0; written && i < m_tracks.size(); ++i)
+    {
+        written = fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":%s}}",
+            first ? "" : ",\n", i, json_string(m_tracks[i]).c_str()) > 0;
+        first = false;
+    }
+
+    for (size_t i = 0; written && i < m_spans.size(); ++i)
+    {
+        const Span& span = m_spans[i];
+
+        written = fprintf(file, "%s{\"name\":\"%s\",\"cat\":\"file\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"file\":%s,\"bytes\":%zu", first ? "" : ",\n", span.name, span.track, micros(span.begin),
+            micros(span.end) - micros(span.begin), json_string(span.file).c_str(), span.bytes) > 0;
+
+        if (written && span.tokens) written = fprintf(file, ",\"tokens\":%zu", span.tokens) > 0;
+        if (written && span.from) written = fprintf(file, ",\"from\":\"%s\"", span.from) > 0;
+        written = written && fprintf(file, "}}") > 0;
+        first = false;
+    }
+
+    written = written && fprintf(file, "\n]}\n") > 0;
+    return fclose(file) == 0 && written;
+}
+
+int Trace::named_track(const std::string& name)
+{
+    const auto found = m_tracks_by_name.find(name);
+    if (found != std::end(m_tracks_by_name)) return found->second;
+
+    m_tracks.push_back(name);
+    return m_tracks_by_name[name] = (int)m_tracks.size() - 1;
+}
+
+void Trace::print_slowest(const int count) const
+{
+    std::vector<const Span*> lexed;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (const Span& span : m_spans)
+        {
+            if (strcmp(span.name, "lex") == 0 && !span.from && span.bytes) lexed.push_back(&span);
+        }
+    }
+
+    std::stable_sort(std::begin(lexed), std::end(lexed),
+        [](const Span* lhs, const Span* rhs) { return bytes_per_second(*lhs) < bytes_per_second(*rhs); });
+
+    if (lexed.size() > (size_t)count) lexed.resize(count);
+
+    printf("Slowest files to lex:\n");
+
+    for (const Span* span : lexed)
+    {
+        const double ms = std::chrono::duration<double, std::milli>(span->end - span->begin).count();
+        printf("  %8.1f MB/s %9.3f ms %10zu bytes %9zu tokens  %s\n", bytes_per_second(*span) / (1024.0 * 1024.0), ms,
+            span->bytes, span->tokens, span->file.c_str());
+    }
+}
+
+namespace
+{
+    std::string json_string(const std::string_view text)
+    {
+        std::string quoted = "\"";
+
+        for (const char ch : text)
+        {
+            if (ch == '"' || ch == '\\')
+            {
+                quoted += '\\';
+                quoted += ch;
+            }
+            else if ((unsigned char)ch < 0x20)
+            {
+                char escape[8];
+                snprintf(escape, sizeof(escape), "\\u%04x", ch);
+                quoted += escape;
+            }
+            else
+            {
+                quoted += ch;
+            }
+        }
+
+        return quoted + '"';
+    }
+
+    double bytes_per_second(const Trace::Span& span)
+    {
+        const double seconds = std::chrono::duration<double>(span.end - span.begin).count();
+        return seconds > 0.0 ? span.bytes / seconds : 1e300;
+    }
+}
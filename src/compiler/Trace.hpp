@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// When each file of a build was read and lexed, and on which thread, for finding the inputs that are slow to lex and
+// seeing how evenly the work was spread. Written out in the Chrome trace event format, which chrome://tracing and
+// Perfetto open. All members are safe to call from several threads at once.
+class Trace
+{
+public:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Span
+    {
+        const char* name; // "read", "lex", "preprocess"
+        int track;
+        Clock::time_point begin;
+        Clock::time_point end;
+
+        std::string file;
+        size_t bytes = 0;
+        size_t tokens = 0;
+
+        // Where a lex span's tokens came from, if they weren't lexed: "token cache" or "snapshot".
+        const char* from = nullptr;
+    };
+
+    Trace();
+
+    // The track for spans on the calling thread; threads are numbered in the order they first ask.
+    int thread_track();
+
+    // A track of another name, such as one per read buffer, for spans that don't belong to a thread.
+    int track(const std::string& name);
+
+    void add(Span span);
+
+    // Returns false if path couldn't be written.
+    bool write(const std::filesystem::path& path) const;
+
+    // Prints the count slowest files to lex, by bytes a second. Files that weren't lexed don't count.
+    void print_slowest(int count) const;
+
+private:
+    // m_mutex must be held.
+    int named_track(const std::string& name);
+
+    Clock::time_point m_start;
+
+    mutable std::mutex m_mutex;
+    std::vector<Span> m_spans;
+    std::vector<std::string> m_tracks; // names, by track
+    std::map<std::string, int> m_tracks_by_name;
+    std::map<std::thread::id, int> m_threads;
+};
@@ -0,0 +1,123 @@
+#include "WorkPool.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct WorkPool::Queue
+{
+    std::mutex mutex;
+    std::deque<int> tasks;
+};
+
+WorkPool::WorkPool(const int thread_count)
+{
+    const int count = thread_count > 0 ? thread_count : std::max(1, (int)std::thread::hardware_concurrency());
+
+    for (int i = 0; i < count; ++i)
+    {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+}
+
+WorkPool::~WorkPool() = default;
+
+void WorkPool::run(const std::vector<int>& tasks, const Job& job)
+{
+    m_pending = (int)tasks.size();
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        m_queues[i % m_queues.size()]->tasks.push_back(tasks[i]);
+    }
+
+    const auto worker_loop = [this, &job](const int worker)
+    {
+        while (m_pending > 0)
+        {
+            int task;
+
+            if (pop(worker, &task) || steal(worker, &task))
+            {
+                job(task, worker);
+                --m_pending;
+            }
+            else
+            {
+                // Everything left is in flight on other workers, which may still push more work.
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+
+    for (int worker = 1; worker < thread_count(); ++worker)
+    {
+        threads.emplace_back(worker_loop, worker);
+    }
+
+    worker_loop(0);
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void WorkPool::push(const int worker, const int task)
+{
+    ++m_pending;
+
+    Queue& queue = *m_queues[worker];
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(task);
+}
+
+int WorkPool::borrow(const int count)
+{
+    // Tasks still pending are either queued or running, and each has or will have a worker of its own.
+    int lent = m_lent;
+
+    while (true)
+    {
+        const int spare = std::clamp(thread_count() - m_pending - lent, 0, count);
+        if (spare == 0 || m_lent.compare_exchange_weak(lent, lent + spare)) return spare;
+    }
+}
+
+void WorkPool::give_back(const int count)
+{
+    m_lent -= count;
+}
+
+bool WorkPool::pop(const int worker, int* task)
+{
+    Queue& queue = *m_queues[worker];
+    std::lock_guard lock(queue.mutex);
+
+    if (queue.tasks.empty()) return false;
+
+    *task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+}
+
+bool WorkPool::steal(const int worker, int* task)
+{
+    for (int i = 1; i < thread_count(); ++i)
+    {
+        Queue& queue = *m_queues[(worker + i) % thread_count()];
+        std::lock_guard lock(queue.mutex);
+
+        if (!queue.tasks.empty())
+        {
+            *task = queue.tasks.back();
+            queue.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// A fixed set of workers, each with its own task queue.
+// Workers take from the front of their own queue and, once it runs dry, steal from the back of the others'.
+// Tasks are plain indices into whatever the caller is working on.
+class WorkPool
+{
+public:
+    using Job = std::function<void(int task, int worker)>;
+
+    explicit WorkPool(int thread_count);
+    ~WorkPool();
+
+    int thread_count() const { return (int)m_queues.size(); }
+
+    // Runs job for every task and blocks until they (and anything pushed while running) are done.
+    // Tasks are dealt round-robin in the order given, so each worker starts on the first tasks of the list.
+    void run(const std::vector<int>& tasks, const Job& job);
+
+    // Queues another task from inside a job; run() will not return until it has completed.
+    void push(int worker, int task);
+
+    // Lends a job up to count more threads, for work of its own that it splits across them (such as lexing one large file
+    // with LexerOptions::threads): as many as there are workers with nothing left to take, that aren't already lent.
+    // This is none while there are still tasks waiting, which would keep those workers busy anyway. Returns how many were
+    // lent, to be handed back with give_back once the job's own threads are done.
+    int borrow(int count);
+    void give_back(int count);
+
+private:
+    struct Queue;
+
+    bool pop(int worker, int* task);
+    bool steal(int worker, int* task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic<int> m_pending = 0;
+    std::atomic<int> m_lent = 0;
+};
@@ -1,69 +1,716 @@
+#include "DependencyGraph.hpp"
+#include "FileReader.hpp"
+#include "FileWatcher.hpp"
+#include "IncludeCache.hpp"
+#include "SourceFile.hpp"
+#include "TokenCache.hpp"
+#include "Trace.hpp"
+#include "WorkPool.hpp"
+
 #include <nwtrees/Lexer.hpp>
-#include <nwtrees/util/Assert.hpp>
+#include <nwtrees/LineTable.hpp>
+#include <nwtrees/Preprocessor.hpp>
+#include <nwtrees/Snapshot.hpp>
+#include <nwtrees/util/Hash.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+struct Script
+{
+    std::filesystem::path path;
+    std::uintmax_t size;
+};
+
+// Everything a worker keeps between files. Padded out so workers don't share cache lines.
+struct alignas(64) Worker
+{
+    nwtrees::LexerOutput lexer;
+    nwtrees::LineTable lines;
+    std::vector<int> failed_scripts;
+    size_t cache_hits = 0;
+    size_t snapshot_hits = 0;
+    size_t unit_tokens = 0;
+    float lex_time = 0.0f;
+    nwtrees::LexerStats stats;
+};
 
-std::string read_source_file(const char* path)
+void print_usage()
 {
-    FILE* file = std::fopen(path, "rb");
+    printf("Usage: nwtrees [-j N] [-k] [--cache DIR] [--preprocess] [-I DIR]... [--deps FILE] [--read-ahead N] [--stats | --stats-cycles] [--trace FILE] [--top N] [--watch] [folder]\n");
+    printf("  -j N            Lex with N worker threads (0 = one per hardware thread), splitting scripts\n");
+    printf("                  of 512 KB or more across those that have run out of scripts. Defaults to 1.\n");
+    printf("  -k              Keep lexing past errors, so every error in a script is reported.\n");
+    printf("  --cache DIR     Reuse the tokens of scripts lexed by earlier runs, keeping them in DIR.\n");
+    printf("  --preprocess    Apply #include and #define, lexing each included file once for the whole build.\n");
+    printf("  -I DIR          With --preprocess, also look for includes in DIR.\n");
+    printf("  --deps FILE     With --preprocess, keep what each script includes in FILE, and only build\n");
+    printf("                  the scripts that anything changed since the last build could affect.\n");
+    printf("  --read-ahead N  Without --preprocess, read up to N scripts ahead of the workers lexing them.\n");
+    printf("                  Defaults to four per worker, and no fewer than 8.\n");
+    printf("  --stats         Count where the lexer's input went, over every file it lexed.\n");
+    printf("  --stats-cycles  As --stats, and split lexing time between seek and tokenize. This slows lexing a lot.\n");
+    printf("  --trace FILE    Write when each file was read and lexed, and on which thread, to FILE as a\n");
+    printf("                  Chrome trace (for chrome://tracing or Perfetto).\n");
+    printf("  --top N         List the N files that lexed slowest, by MB/s.\n");
+    printf("  --watch         Keep running after the first build, lexing each script again as soon as it is saved.\n");
+}
 
-    if (file)
+std::string kind_name(const nwtrees::TokenKind kind)
+{
+    switch (nwtrees::token_kind::type(kind))
     {
-        std::fseek(file, 0, SEEK_END);
-        std::size_t len = ftell(file);
-        std::fseek(file, 0, SEEK_SET);
+        case nwtrees::Token::Keyword: return std::string(nwtrees::keywords[kind - nwtrees::token_kind::first_keyword].first);
+        case nwtrees::Token::Punctuator: return std::string(nwtrees::punctuators[kind - nwtrees::token_kind::first_punctuator].first);
+        case nwtrees::Token::Literal:
+        {
+            static constexpr const char* literals[] = { "string literal", "int literal", "float literal" };
+            return literals[kind - nwtrees::token_kind::first_literal];
+        }
+        default: return "identifier";
+    }
+}
+
+void print_stats(const nwtrees::LexerStats& stats)
+{
+    const auto percent = [](const uint64_t part, const uint64_t whole) { return whole ? 100.0 * part / whole : 0.0; };
+
+    uint64_t token_count = 0;
+    for (const uint64_t count : stats.tokens_by_type) token_count += count;
 
-        std::string out;
-        out.resize(len);
+    printf("Lexer stats: %llu files lexed, %llu bytes\n", (unsigned long long)stats.inputs, (unsigned long long)stats.bytes);
+    printf("  Skipped: %.1f%% whitespace, %.1f%% comments, %.1f%% preprocessor lines\n",
+        percent(stats.whitespace_bytes, stats.bytes), percent(stats.comment_bytes, stats.bytes), percent(stats.preprocessor_bytes, stats.bytes));
 
-        size_t read = std::fread(out.data(), 1, len, file);
-        NWTREES_ASSERT(read == len);
+    printf("  Tokens: %llu (%.1f%% identifiers, %.1f%% keywords, %.1f%% literals, %.1f%% punctuators)\n", (unsigned long long)token_count,
+        percent(stats.tokens_by_type[nwtrees::Token::Identifier], token_count), percent(stats.tokens_by_type[nwtrees::Token::Keyword], token_count),
+        percent(stats.tokens_by_type[nwtrees::Token::Literal], token_count), percent(stats.tokens_by_type[nwtrees::Token::Punctuator], token_count));
 
-        std::fclose(file);
-        return out;
+    std::vector<nwtrees::TokenKind> kinds(nwtrees::token_kind::count);
+    std::iota(std::begin(kinds), std::end(kinds), 0);
+    std::stable_sort(std::begin(kinds), std::end(kinds),
+        [&](const nwtrees::TokenKind lhs, const nwtrees::TokenKind rhs) { return stats.tokens_by_kind[lhs] > stats.tokens_by_kind[rhs]; });
+
+    printf("  Most common:");
+
+    for (size_t i = 0; i < 10 && stats.tokens_by_kind[kinds[i]]; ++i)
+    {
+        printf("%s %s %.1f%%", i ? "," : "", kind_name(kinds[i]).c_str(), percent(stats.tokens_by_kind[kinds[i]], token_count));
+    }
+
+    printf("\n");
+    printf("  Strings merged: %llu\n", (unsigned long long)stats.strings_merged);
+    printf("  Largest output: %llu tokens, %llu bytes of names\n", (unsigned long long)stats.tokens_high_water, (unsigned long long)stats.names_high_water);
+
+    if (stats.count_cycles)
+    {
+        const uint64_t cycles = stats.seek_cycles + stats.tokenize_cycles;
+        printf("  Cycles: %.1f%% seek, %.1f%% tokenize (%.2f per byte, %.1f per token)\n",
+            percent(stats.seek_cycles, cycles), percent(stats.tokenize_cycles, cycles),
+            stats.bytes ? (double)cycles / stats.bytes : 0.0, token_count ? (double)cycles / token_count : 0.0);
     }
+}
+
+// lines must have been built from source.
+void print_error(const std::string_view path, const std::string_view source, const nwtrees::LineTable& lines,
+    const nwtrees::Error& error, const std::string_view message)
+{
+    const nwtrees::SourceLocation location = lines.locate(error.offset);
+    const std::string_view line = lines.line_text(source, location.line);
 
-    return "";
+    printf("ERROR: %.*s(%d,%d): %s%s%.*s\n    %.*s\n", (int)path.size(), path.data(),
+        location.line + 1, location.column + 1, nwtrees::Error::describe(error.code),
+        message.empty() ? "" : ": ", (int)message.size(), message.data(), (int)std::min<size_t>(line.size(), 128), line.data());
+}
+
+// As nwtrees::lexer, with as little compiled in as the build needs: without -k, nothing for recovering from errors.
+// options.threads is as many threads as one large source may be split across, of those the pool has to spare.
+nwtrees::LexerOutput lex(const std::string_view source, nwtrees::LexerOutput&& output, const nwtrees::LexerOptions& options, WorkPool& pool)
+{
+    nwtrees::LexerOptions lent_options = options;
+    const int lent = pool.borrow(nwtrees::chunk_count(source.size(), options) - 1);
+    lent_options.threads = 1 + lent;
+
+    nwtrees::LexerOutput lexed = options.recover ? nwtrees::lexer(source, std::move(output), lent_options) :
+        nwtrees::lexer<nwtrees::CompileLexerConfig>(source, std::move(output), lent_options);
+
+    pool.give_back(lent);
+    return lexed;
+}
+
+// Loads the library's built-in nwscript.nss snapshot, if it has one, and path is that file with the same contents.
+bool load_snapshot(const std::filesystem::path& path, const std::string_view source, const nwtrees::LexerOptions& options, nwtrees::LexerOutput& output)
+{
+    const nwtrees::LexerSnapshot* snapshot = nwtrees::nwscript_snapshot();
+    return snapshot && path.filename() == snapshot->name && nwtrees::load_snapshot(*snapshot, source, output, options);
+}
+
+// A script kept lexed between builds, in --watch mode.
+struct WatchedScript
+{
+    std::string source;
+    nwtrees::LexerOutput output;
+    bool lexed = false;
+};
+
+// Whether path is dir or something under it.
+bool is_within(const std::filesystem::path& path, const std::filesystem::path& dir)
+{
+    return std::mismatch(dir.begin(), dir.end(), path.begin(), path.end()).first == dir.end();
+}
+
+// Lexes every script under folder, then keeps them all lexed, lexing each one again as soon as it changes on disk.
+// Nothing is read or lexed again unless it changed, so a build after a save costs reading and lexing that one file.
+// Only returns if watching fails.
+int watch(const std::filesystem::path& folder, const int thread_count, nwtrees::LexerOptions options, const TokenCache* cache)
+{
+    // Started before the first scan, so nothing saved during it is missed.
+    FileWatcher watcher(folder);
+
+    if (!watcher.valid())
+    {
+        printf("ERROR: %s: could not be watched\n", folder.string().c_str());
+        return 1;
+    }
+
+    WorkPool pool(thread_count);
+    options.threads = pool.thread_count();
+
+    std::map<std::filesystem::path, std::unique_ptr<WatchedScript>> scripts;
+    nwtrees::LineTable lines;
+
+    std::vector<std::filesystem::path> changed = { folder };
+    bool first_build = true;
+
+    while (true)
+    {
+        const auto before = std::chrono::high_resolution_clock::now();
+
+        // -- Work out which scripts to look at. A directory stands for everything in it, gone or not.
+
+        std::vector<std::filesystem::path> paths;
+        size_t removed = 0;
+
+        for (const std::filesystem::path& path : changed)
+        {
+            std::error_code error;
+
+            if (std::filesystem::is_directory(path, error))
+            {
+                for (std::filesystem::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error))
+                {
+                    if (it->is_regular_file(error) && it->path().extension() == ".nss") paths.push_back(it->path());
+                }
+            }
+            else if (path.extension() == ".nss" && std::filesystem::is_regular_file(path, error))
+            {
+                paths.push_back(path);
+            }
+
+            for (auto it = std::begin(scripts); it != std::end(scripts); )
+            {
+                if (is_within(it->first, path) && !std::filesystem::exists(it->first, error))
+                {
+                    printf("Removed: %s\n", it->first.string().c_str());
+                    it = scripts.erase(it);
+                    ++removed;
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+        }
+
+        std::sort(std::begin(paths), std::end(paths));
+        paths.erase(std::unique(std::begin(paths), std::end(paths)), std::end(paths));
+
+        std::vector<WatchedScript*> to_read;
+        for (const std::filesystem::path& path : paths)
+        {
+            std::unique_ptr<WatchedScript>& script = scripts[path];
+            if (!script) script = std::make_unique<WatchedScript>();
+            to_read.push_back(script.get());
+        }
+
+        // -- Read them, and lex those whose contents changed. Saving a file without changing it costs a read and a compare.
+
+        std::vector<char> relexed(to_read.size(), 0);
+        std::vector<int> tasks(to_read.size());
+        std::iota(std::begin(tasks), std::end(tasks), 0);
+
+        pool.run(tasks, [&](const int task, int)
+        {
+            WatchedScript& script = *to_read[task];
+
+            SourceFile file;
+            if (!file.open(paths[task].string().c_str())) return;
+            if (script.lexed && file.view() == script.source) return;
+
+            script.source.assign(file.view());
+            file.close();
+
+            const uint64_t cache_key = cache ? TokenCache::key(script.source, options) : 0;
+
+            if (!load_snapshot(paths[task], script.source, options, script.output) && (!cache || !cache->load(cache_key, script.source, script.output, options)))
+            {
+                script.output = lex(script.source, std::move(script.output), options, pool);
+                if (cache) cache->store(cache_key, script.source, script.output, options);
+            }
+
+            script.lexed = true;
+            relexed[task] = 1;
+        });
+
+        // -- Report what changed.
+
+        size_t relexed_count = 0;
+
+        for (size_t i = 0; i < to_read.size(); ++i)
+        {
+            if (!relexed[i]) continue;
+            ++relexed_count;
+
+            const WatchedScript& script = *to_read[i];
+            if (!script.output.errors.empty()) lines.build(script.source);
+
+            for (const nwtrees::Error& error : script.output.errors)
+            {
+                print_error(paths[i].string(), script.source, lines, error, script.output.message(error));
+            }
+        }
+
+        size_t failed_count = 0;
+        for (const auto& [_, script] : scripts) failed_count += !script->output.errors.empty();
+
+        const float time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - before).count() / 1000000.0f;
+
+        if (first_build)
+        {
+            printf("Watching %zu scripts (%zu failed) on %d threads; lexed in %.2f ms\n", scripts.size(), failed_count, pool.thread_count(), time);
+        }
+        else if (relexed_count || removed)
+        {
+            printf("Lexed %zu changed scripts in %.2f ms; %zu of %zu scripts failed\n", relexed_count, time, failed_count, scripts.size());
+        }
+
+        fflush(stdout);
+        first_build = false;
+
+        changed.clear();
+        if (!watcher.wait(changed, -1))
+        {
+            printf("ERROR: %s: watching failed\n", folder.string().c_str());
+            return 1;
+        }
+    }
 }
 
 int main(const int argc, const char** argv)
 {
     std::filesystem::path folder = "D:/_nwn/_server_codebases";
+    int thread_count = 1;
+    std::unique_ptr<TokenCache> cache;
+    nwtrees::LexerOptions options;
+    bool preprocess = false;
+    bool collect_stats = false;
+    bool count_cycles = false;
+    bool watch_folder = false;
+    std::vector<std::filesystem::path> include_dirs;
+    std::filesystem::path deps_path;
+    int read_ahead = 0;
+    std::filesystem::path trace_path;
+    int top_count = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "-j", 2) == 0)
+        {
+            const char* value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : nullptr);
+            if (!value) { print_usage(); return 1; }
+            thread_count = atoi(value);
+        }
+        else if (strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--keep-going") == 0)
+        {
+            options.recover = true;
+        }
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            if (i + 1 >= argc) { print_usage(); return 1; }
+            cache = std::make_unique<TokenCache>(argv[++i]);
+
+            if (!cache->valid())
+            {
+                printf("ERROR: %s: cache directory could not be created\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--preprocess") == 0)
+        {
+            preprocess = true;
+        }
+        else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats-cycles") == 0)
+        {
+            collect_stats = true;
+            count_cycles = count_cycles || strcmp(argv[i], "--stats-cycles") == 0;
+        }
+        else if (strncmp(argv[i], "-I", 2) == 0)
+        {
+            const char* value = argv[i][2] ? argv[i] + 2 : (i + 1 < argc ? argv[++i] : nullptr);
+            if (!value) { print_usage(); return 1; }
+            include_dirs.push_back(value);
+        }
+        else if (strcmp(argv[i], "--deps") == 0)
+        {
+            if (i + 1 >= argc) { print_usage(); return 1; }
+            deps_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--read-ahead") == 0)
+        {
+            if (i + 1 >= argc) { print_usage(); return 1; }
+            read_ahead = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--trace") == 0)
+        {
+            if (i + 1 >= argc) { print_usage(); return 1; }
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--top") == 0)
+        {
+            if (i + 1 >= argc) { print_usage(); return 1; }
+            top_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--watch") == 0)
+        {
+            watch_folder = true;
+        }
+        else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            print_usage();
+            return 0;
+        }
+        else
+        {
+            folder = argv[i];
+        }
+    }
+
+    if (!deps_path.empty() && !preprocess)
+    {
+        printf("ERROR: --deps needs --preprocess\n");
+        return 1;
+    }
+
+    if (watch_folder)
+    {
+        // Included files would have to be tracked through everything that includes them.
+        if (preprocess || collect_stats || !trace_path.empty() || top_count > 0)
+        {
+            printf("ERROR: --watch can't be combined with --preprocess, --stats, --trace or --top\n");
+            return 1;
+        }
+
+        return watch(folder, thread_count, options, cache.get());
+    }
 
-    std::vector<std::filesystem::path> scripts_to_build;
+    std::vector<Script> scripts_to_build;
 
     for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(folder))
     {
         if (std::filesystem::is_regular_file(entry) &&
             entry.path().extension() == ".nss")
         {
-            scripts_to_build.push_back(entry.path());
+            scripts_to_build.push_back({ entry.path(), entry.file_size() });
         }
     }
 
-    float total_time = 0.0f;
+    // Largest first, so the last files to finish are small ones and the workers drain together.
+    std::vector<int> order(scripts_to_build.size());
+    std::iota(std::begin(order), std::end(order), 0);
+    std::stable_sort(std::begin(order), std::end(order),
+        [&](const int lhs, const int rhs) { return scripts_to_build[lhs].size > scripts_to_build[rhs].size; });
 
-    nwtrees::LexerOutput lexer;
+    // With a dependency graph, only the scripts that something changed could affect are built, and everything
+    // they are known to include is lexed first, the most included files before the files that include them.
+    std::unique_ptr<DependencyGraph> deps;
+    std::vector<std::filesystem::path> prelex_order;
+
+    if (!deps_path.empty())
+    {
+        // A different lexer, or different include directories, could find different files or tokens anywhere.
+        std::string config = std::to_string(nwtrees::lexer_version);
+        for (const std::filesystem::path& dir : include_dirs) config += '\n' + std::filesystem::absolute(dir).lexically_normal().string();
+
+        deps = std::make_unique<DependencyGraph>(deps_path, nwtrees::hash::xxh64(config));
+        deps->load();
+
+        std::vector<std::filesystem::path> paths;
+        for (const Script& script : scripts_to_build) paths.push_back(script.path);
+
+        const std::vector<char> affected = deps->affected(paths, include_dirs);
+        order.erase(std::remove_if(std::begin(order), std::end(order), [&](const int task) { return !affected[task]; }), std::end(order));
+        prelex_order = deps->build_order(paths, affected);
+    }
 
-    for (const std::filesystem::path& path : scripts_to_build)
+    WorkPool pool(thread_count);
+    std::vector<Worker> workers(pool.thread_count());
+
+    // A script big enough to split (generated tables, mostly) is lexed on the workers that have run out of scripts.
+    options.threads = pool.thread_count();
+
+    std::unique_ptr<Trace> trace;
+    if (!trace_path.empty() || top_count > 0) trace = std::make_unique<Trace>();
+
+    std::unique_ptr<IncludeCache> includes;
+    if (preprocess) includes = std::make_unique<IncludeCache>(include_dirs, options, cache.get(), collect_stats, count_cycles, trace.get(), &pool);
+
+    for (Worker& worker : workers) worker.stats.count_cycles = count_cycles;
+
+    const auto wall_before = std::chrono::high_resolution_clock::now();
+
+    // Each script is a translation unit; whichever one first includes a file lexes it, for all of them.
+    const auto preprocess_script = [&](const int task, const int worker_idx)
     {
-        const std::string file = read_source_file(path.string().c_str());
+        Worker& worker = workers[worker_idx];
 
         const auto before = std::chrono::high_resolution_clock::now();
-        lexer = nwtrees::lexer(file.c_str(), std::move(lexer));
+
+        const IncludeCache::File* root = includes->load(scripts_to_build[task].path);
+
+        if (!root)
+        {
+            printf("ERROR: %s: could not be read\n", scripts_to_build[task].path.string().c_str());
+            worker.failed_scripts.push_back(task);
+            return;
+        }
+
+        nwtrees::TranslationUnit unit(root->lexed, [&](const std::string_view name, const nwtrees::LexedFile& from) -> const nwtrees::LexedFile*
+        {
+            const IncludeCache::File* file = includes->find(name, from);
+            if (deps) deps->record_include(std::filesystem::path(from.name), name, file ? &file->path : nullptr);
+            return file ? &file->lexed : nullptr;
+        });
+
+        nwtrees::PreprocessedToken token;
+        size_t tokens = 0;
+        while (unit.next(&token)) ++tokens;
+        worker.unit_tokens += tokens;
+
         const auto after = std::chrono::high_resolution_clock::now();
 
-        const float ms = std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count() / 1000000.0f;
-        total_time += ms;
+        // Includes lexed along the way have spans of their own, inside this one.
+        if (trace) trace->add({ "preprocess", trace->thread_track(), before, after, root->name, root->lexed.source.size(), tokens });
+
+        worker.lex_time += std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count() / 1000000.0f;
+
+        // Lexer errors are reported once per file, after the build; a script fails if any file it includes has one.
+        bool failed = !unit.errors().empty();
+
+        for (const nwtrees::LexedFile* file : unit.files())
+        {
+            failed = failed || !file->output.errors.empty();
+        }
+
+        for (const nwtrees::PreprocessorError& error : unit.errors())
+        {
+            worker.lines.build(error.file->source);
+            print_error(error.file->name, error.file->source, worker.lines, error.error, unit.message(error));
+        }
+
+        if (failed) worker.failed_scripts.push_back(task);
+    };
+
+    const auto lex_script = [&](const FileReader::File& file, const int worker_idx)
+    {
+        Worker& worker = workers[worker_idx];
+        const int task = order[file.idx];
+
+        if (!file.read)
+        {
+            printf("ERROR: %s: could not be read\n", scripts_to_build[task].path.string().c_str());
+            worker.failed_scripts.push_back(task);
+            return;
+        }
+
+        const auto before = std::chrono::high_resolution_clock::now();
+
+        const uint64_t cache_key = cache ? TokenCache::key(file.data, options) : 0;
+        const char* from = nullptr;
 
-        if (!lexer.errors.empty())
+        if (load_snapshot(scripts_to_build[task].path, file.data, options, worker.lexer))
+        {
+            ++worker.snapshot_hits;
+            from = "snapshot";
+        }
+        else if (cache && cache->load(cache_key, file.data, worker.lexer, options))
+        {
+            ++worker.cache_hits;
+            from = "token cache";
+        }
+        else
         {
-            printf("ERROR: %d\n", lexer.errors[0].code);
-            __debugbreak();
+            worker.lexer = collect_stats ?
+                nwtrees::lexer(file.data, std::move(worker.lexer), options, worker.stats) :
+                lex(file.data, std::move(worker.lexer), options, pool);
+            if (cache) cache->store(cache_key, file.data, worker.lexer, options);
         }
+
+        const auto after = std::chrono::high_resolution_clock::now();
+
+        worker.lex_time += std::chrono::duration_cast<std::chrono::nanoseconds>(after - before).count() / 1000000.0f;
+
+        if (trace)
+        {
+            // Reads overlap, so each buffer has a track, rather than the reader's one thread.
+            const std::string name = scripts_to_build[task].path.string();
+            trace->add({ "read", trace->track("read buffer " + std::to_string(file.buffer + 1)), file.read_begin, file.read_end, name, file.data.size() });
+            trace->add({ "lex", trace->thread_track(), before, after, name, file.data.size(), worker.lexer.tokens.size(), from });
+        }
+
+        if (!worker.lexer.errors.empty())
+        {
+            worker.lines.build(file.data);
+
+            for (const nwtrees::Error& error : worker.lexer.errors)
+            {
+                print_error(scripts_to_build[task].path.string(), file.data, worker.lines, error, worker.lexer.message(error));
+            }
+
+            worker.failed_scripts.push_back(task);
+        }
+    };
+
+    if (!prelex_order.empty())
+    {
+        std::vector<int> tasks(prelex_order.size());
+        std::iota(std::begin(tasks), std::end(tasks), 0);
+        pool.run(tasks, [&](const int task, int) { includes->load(prelex_order[task]); });
+    }
+
+    if (preprocess) pool.run(order, preprocess_script);
+    else
+    {
+        // Scripts are read ahead of the workers, in the order they are to be built, and lexed in the order the reads finish.
+        std::vector<std::filesystem::path> paths;
+        for (const int task : order) paths.push_back(scripts_to_build[task].path);
+        FileReader reader(std::move(paths), read_ahead > 0 ? read_ahead : std::max(4 * pool.thread_count(), 8));
+
+        // One job per worker, each taking scripts as they are read until there are none left.
+        std::vector<int> jobs(pool.thread_count());
+        std::iota(std::begin(jobs), std::end(jobs), 0);
+
+        pool.run(jobs, [&](int, const int worker_idx)
+        {
+            FileReader::File file;
+
+            while (reader.next(&file))
+            {
+                lex_script(file, worker_idx);
+                reader.release(file);
+            }
+        });
+    }
+
+    const auto wall_after = std::chrono::high_resolution_clock::now();
+
+    float cpu_time = 0.0f;
+    size_t failed_count = 0;
+    size_t cache_hits = 0;
+    size_t snapshot_hits = 0;
+    size_t unit_tokens = 0;
+    nwtrees::LexerStats stats;
+
+    for (const Worker& worker : workers)
+    {
+        stats.add(worker.stats);
+        cpu_time += worker.lex_time;
+        failed_count += worker.failed_scripts.size();
+        cache_hits += worker.cache_hits;
+        snapshot_hits += worker.snapshot_hits;
+        unit_tokens += worker.unit_tokens;
+    }
+
+    size_t file_count = scripts_to_build.size();
+
+    if (includes)
+    {
+        std::vector<const IncludeCache::File*> files = includes->files();
+        std::sort(std::begin(files), std::end(files), [](const IncludeCache::File* lhs, const IncludeCache::File* rhs) { return lhs->name < rhs->name; });
+
+        nwtrees::LineTable lines;
+        file_count = files.size();
+        cache_hits = 0;
+
+        for (const IncludeCache::File* file : files)
+        {
+            cache_hits += file->from_token_cache;
+            snapshot_hits += file->from_snapshot;
+            stats.add(file->stats);
+            if (!file->lexed.output.errors.empty()) lines.build(file->lexed.source);
+
+            for (const nwtrees::Error& error : file->lexed.output.errors)
+            {
+                print_error(file->name, file->lexed.source, lines, error, file->lexed.output.message(error));
+            }
+        }
+    }
+
+    const float wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(wall_after - wall_before).count() / 1000000.0f;
+
+    if (deps)
+    {
+        std::vector<char> failed(scripts_to_build.size(), 0);
+        for (const Worker& worker : workers)
+        {
+            for (const int task : worker.failed_scripts) failed[task] = 1;
+        }
+
+        for (const IncludeCache::File* file : includes->files()) deps->record_file(file->path, file->lexed.source);
+        for (const int task : order) deps->record_script(scripts_to_build[task].path, failed[task]);
+
+        if (!deps->save()) printf("ERROR: %s: dependency graph could not be written\n", deps_path.string().c_str());
+        printf("Dependencies: %zu of %zu scripts affected by changes since the last build\n", order.size(), scripts_to_build.size());
     }
 
-    printf("Total runtime: %.2f ms\n", total_time);
+    if (includes)
+    {
+        printf("Preprocessed %zu scripts (%zu failed) on %d threads\n", order.size(), failed_count, pool.thread_count());
+        printf("Translation units: %zu tokens, from %zu distinct files lexed once each\n", unit_tokens, file_count);
+    }
+    else
+    {
+        printf("Lexed %zu scripts (%zu failed) on %d threads\n", scripts_to_build.size(), failed_count, pool.thread_count());
+    }
+
+    if (snapshot_hits)
+    {
+        const std::string_view name = nwtrees::nwscript_snapshot()->name;
+        printf("Token snapshot: %.*s loaded without lexing\n", (int)name.size(), name.data());
+    }
+    if (cache) printf("Token cache: %zu of %zu files loaded\n", cache_hits, file_count);
+    if (collect_stats)
+    {
+        stats.count_cycles = count_cycles;
+        print_stats(stats);
+    }
+
+    if (top_count > 0) trace->print_slowest(top_count);
+    if (!trace_path.empty())
+    {
+        if (trace->write(trace_path)) printf("Trace: written to %s\n", trace_path.string().c_str());
+        else printf("ERROR: %s: trace could not be written\n", trace_path.string().c_str());
+    }
+
+    printf("Wall time: %.2f ms\n", wall_time);
+    printf("Total runtime: %.2f ms (lexing, summed over workers)\n", cpu_time);
     fflush(stdout);
+
+    return failed_count ? 1 : 0;
 }
@@ -0,0 +1,695 @@
+// Writes a corpus of made-up nwscript, for benchmarking the lexer at any size without anyone's real module sources.
+// The same seed and options always write the same files, on any machine: it uses its own random numbers rather than
+// the standard library's distributions, which differ between implementations.
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+    struct Mix
+    {
+        int keywords = 30; // percent of statements that are control flow (if, while, for, switch, return)
+        int identifiers = 60; // percent of operands that are names rather than literals
+        int comments = 15; // percent of each file's bytes that are comments
+        int strings = 5; // percent of string literals that are long ones
+        int tables = 10; // percent of scripts that are numeric tables
+        int fan_out = 3; // includes per script and per header
+        int depth = 3; // levels of headers below the scripts
+    };
+
+    // splitmix64: small, fast, and the same everywhere.
+    struct Random
+    {
+        uint64_t state;
+
+        uint64_t next();
+        int below(int count);
+        bool chance(int percent) { return below(100) < percent; }
+        int between(int lo, int hi) { return lo + below(hi - lo + 1); }
+
+        template <size_t N>
+        const char* pick(const char* const (&items)[N]) { return items[below((int)N)]; }
+    };
+
+    // Writes one file's text into out. Functions are added until the file reaches the size it was given.
+    class Writer
+    {
+    public:
+        Writer(Random& random, const Mix& mix, std::string& out);
+
+        void header(const std::vector<std::string>& includes, size_t size);
+        void script(const std::vector<std::string>& includes, size_t size);
+        void table(size_t size);
+
+    private:
+        void includes(const std::vector<std::string>& names);
+        void function(bool is_main);
+        void block(int depth);
+        void statement(int depth);
+        void expression(int depth);
+        void operand();
+        void call(int depth);
+        void string_literal();
+        void int_literal();
+        void float_literal();
+        void name(const char* prefix);
+        void comments(int depth);
+        void comment();
+        void indent(int depth);
+
+        Random& m_random;
+        const Mix& m_mix;
+        std::string& m_out;
+        size_t m_comment_bytes = 0;
+        size_t m_size = 0;
+    };
+
+    bool parse_size(const char* text, uint64_t* size);
+    bool write_file(const std::filesystem::path& path, const std::string& data);
+    std::string header_name(int level, int idx);
+}
+
+void print_usage()
+{
+    printf("Usage: nwtrees_corpus [options] <folder>\n");
+    printf("  --seed N          Which corpus to write; the same seed and options always write the same one. Defaults to 1.\n");
+    printf("  --size SIZE       Roughly how much to write in all, as bytes or with K, M or G. Defaults to 16M.\n");
+    printf("  --file-size SIZE  The typical size of a script; each is between a quarter of it and four times it. Defaults to 16K.\n");
+    printf("  --keywords PCT    Percent of statements that are control flow. Defaults to 30.\n");
+    printf("  --identifiers PCT Percent of operands that are names rather than literals. Defaults to 60.\n");
+    printf("  --comments PCT    Percent of each file that is comments. Defaults to 15.\n");
+    printf("  --strings PCT     Percent of string literals that are hundreds of characters long. Defaults to 5.\n");
+    printf("  --tables PCT      Percent of scripts that are tables of numbers. Defaults to 10.\n");
+    printf("  --fan-out N       #includes in each script and each header. Defaults to 3.\n");
+    printf("  --depth N         Levels of headers including headers, under folder/include. Defaults to 3.\n");
+    printf("Scripts go in folder/scripts. Build them with --preprocess -I folder/include to follow the includes.\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* folder_arg = nullptr;
+    uint64_t seed = 1;
+    uint64_t total_size = 16 << 20;
+    uint64_t file_size = 16 << 10;
+    Mix mix;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        bool valid = true;
+
+        if (strcmp(argv[i], "--seed") == 0 && has_value) seed = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--size") == 0 && has_value) valid = parse_size(argv[++i], &total_size);
+        else if (strcmp(argv[i], "--file-size") == 0 && has_value) valid = parse_size(argv[++i], &file_size) && file_size > 0;
+        else if (strcmp(argv[i], "--keywords") == 0 && has_value) mix.keywords = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--identifiers") == 0 && has_value) mix.identifiers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--comments") == 0 && has_value) mix.comments = std::min(atoi(argv[++i]), 90);
+        else if (strcmp(argv[i], "--strings") == 0 && has_value) mix.strings = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tables") == 0 && has_value) mix.tables = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fan-out") == 0 && has_value) mix.fan_out = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--depth") == 0 && has_value) mix.depth = std::max(0, atoi(argv[++i]));
+        else if (argv[i][0] != '-') folder_arg = argv[i];
+        else
+        {
+            print_usage();
+            return strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+
+        if (!valid)
+        {
+            printf("ERROR: %s: not a size\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (!folder_arg)
+    {
+        print_usage();
+        return 1;
+    }
+
+    const std::filesystem::path folder = folder_arg;
+    const std::filesystem::path include_dir = folder / "include";
+    const std::filesystem::path script_dir = folder / "scripts";
+
+    std::error_code error;
+    std::filesystem::create_directories(script_dir, error);
+    if (!error && mix.depth && mix.fan_out) std::filesystem::create_directories(include_dir, error);
+
+    if (error)
+    {
+        printf("ERROR: %s: could not be created\n", folder.string().c_str());
+        return 1;
+    }
+
+    // Every file has a generator of its own, seeded from the corpus seed and the file, so changing how one file is
+    // written (or how many there are) leaves the rest as they were.
+    const auto file_random = [&](const uint64_t kind, const uint64_t idx)
+    {
+        Random random = { seed ^ (kind << 56) ^ idx };
+        random.next();
+        return random;
+    };
+
+    std::string data;
+    uint64_t written = 0;
+    size_t header_count = 0;
+    size_t script_count = 0;
+
+    // -- Headers: each level is twice as wide as the one above it, and each header includes fan_out of the level below.
+    // They're kept small, so that however little is asked for, there's room for scripts as well.
+
+    int levels = mix.fan_out ? mix.depth : 0;
+    std::vector<int> level_width;
+    size_t headers_wanted = 0;
+
+    for (int level = 0; level < levels; ++level)
+    {
+        level_width.push_back(std::min(mix.fan_out << std::min(level + 1, 10), 1024));
+        headers_wanted += level_width[level];
+
+        // A small corpus gets fewer levels, rather than being all headers.
+        if (headers_wanted * 64 > total_size / 4)
+        {
+            headers_wanted -= level_width[level];
+            level_width.pop_back();
+            levels = level;
+        }
+    }
+
+    const uint64_t header_size = headers_wanted ? std::clamp<uint64_t>(total_size / (4 * headers_wanted), 64, file_size / 2 + 64) : 0;
+
+    const auto pick_includes = [&](Random& random, const int level)
+    {
+        std::vector<std::string> names;
+        if (level >= levels) return names;
+
+        for (int i = 0; i < mix.fan_out; ++i)
+        {
+            std::string name = header_name(level, random.below(level_width[level]));
+            if (std::find(std::begin(names), std::end(names), name) == std::end(names)) names.push_back(std::move(name));
+        }
+
+        return names;
+    };
+
+    for (int level = 0; level < levels; ++level)
+    {
+        for (int idx = 0; idx < level_width[level]; ++idx)
+        {
+            Random random = file_random(1, header_count);
+            data.clear();
+
+            Writer writer(random, mix, data);
+            writer.header(pick_includes(random, level + 1), header_size);
+
+            if (!write_file(include_dir / (header_name(level, idx) + ".nss"), data)) return 1;
+            written += data.size();
+            ++header_count;
+        }
+    }
+
+    // -- Scripts, until there's enough of everything; a thousand to a folder, as large modules tend to be split.
+
+    while (written < total_size || script_count == 0)
+    {
+        Random random = file_random(2, script_count);
+        data.clear();
+
+        // Between a quarter and four times the typical size, the small end more likely, as it is in real modules.
+        const int step = random.between(0, 16);
+        uint64_t size = file_size / 4 + file_size * step * step * 15 / 1024;
+        size = std::max<uint64_t>(std::min(size, total_size > written ? total_size - written : 0), 256);
+
+        Writer writer(random, mix, data);
+        const bool is_table = random.chance(mix.tables);
+
+        if (is_table) writer.table(size);
+        else writer.script(pick_includes(random, 0), size);
+
+        char name[32];
+        snprintf(name, sizeof(name), "%s%07zu.nss", is_table ? "t" : "s", script_count);
+
+        char dir[32];
+        snprintf(dir, sizeof(dir), "%04zu", script_count / 1000);
+
+        if (script_count % 1000 == 0)
+        {
+            std::filesystem::create_directories(script_dir / dir, error);
+
+            if (error)
+            {
+                printf("ERROR: %s: could not be created\n", (script_dir / dir).string().c_str());
+                return 1;
+            }
+        }
+
+        if (!write_file(script_dir / dir / name, data)) return 1;
+        written += data.size();
+        ++script_count;
+    }
+
+    printf("Wrote %zu scripts and %zu headers, %llu bytes, to %s\n", script_count, header_count, (unsigned long long)written, folder.string().c_str());
+    return 0;
+}
+
+namespace
+{
+    static constexpr const char* types[] = { "int", "int", "int", "float", "string", "string", "object", "object", "vector", "location", "effect" };
+
+    static constexpr const char* functions[] =
+    {
+        "GetLocalInt", "SetLocalInt", "GetLocalString", "SetLocalString", "GetLocalObject", "GetObjectByTag", "GetFirstPC", "GetNextPC",
+        "GetIsObjectValid", "GetHitDice", "GetTag", "GetName", "SendMessageToPC", "FloatingTextStringOnCreature", "IntToString",
+        "FloatToString", "StringToInt", "GetStringLength", "GetSubString", "Random", "d20", "d6", "DelayCommand", "AssignCommand",
+        "ApplyEffectToObject", "EffectDamage", "EffectHeal", "GetArea", "GetPosition", "GetDistanceBetween", "GetModule",
+    };
+
+    static constexpr const char* words[] =
+    {
+        "the", "player", "creature", "area", "spawn", "door", "trigger", "quest", "reward", "item", "gold", "check", "when",
+        "state", "every", "round", "heartbeat", "if", "not", "valid", "loop", "over", "party", "members", "and", "then",
+        "apply", "effect", "to", "target", "module", "load", "store", "on", "variable", "later", "XP", "level", "faction",
+    };
+
+    static constexpr const char* prefixes[] = { "n", "f", "s", "o", "b", "l", "e", "v" };
+    static constexpr const char* stems[] = { "Count", "Target", "Damage", "Level", "Gold", "Index", "Area", "Item", "Door", "Quest", "State", "Timer", "Spawn", "Pc" };
+
+    static constexpr const char* binary_ops[] = { "+", "-", "*", "/", "%", "==", "!=", "<", ">", "<=", ">=", "&&", "||", "&", "|", "^", "<<", ">>" };
+    static constexpr const char* assign_ops[] = { "=", "+=", "-=", "*=", "|=", "&=" };
+
+    uint64_t Random::next()
+    {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    int Random::below(const int count)
+    {
+        return count <= 0 ? 0 : (int)(((next() >> 32) * (uint64_t)count) >> 32);
+    }
+
+    Writer::Writer(Random& random, const Mix& mix, std::string& out)
+        : m_random(random),
+          m_mix(mix),
+          m_out(out)
+    {
+    }
+
+    void Writer::header(const std::vector<std::string>& names, const size_t size)
+    {
+        m_size = size;
+        includes(names);
+
+        // Constants and prototypes up front, as game headers have them, then the definitions.
+        const int constants = m_random.between(4, 24);
+
+        for (int i = 0; i < constants; ++i)
+        {
+            if (m_out.size() >= size) return;
+            comments(0);
+
+            const bool is_string = m_random.chance(20);
+            m_out += is_string ? "const string " : "const int ";
+            name("CONST_");
+            m_out += " = ";
+            if (is_string) string_literal();
+            else int_literal();
+            m_out += ";\n";
+        }
+
+        m_out += '\n';
+        while (m_out.size() < size) function(false);
+    }
+
+    void Writer::script(const std::vector<std::string>& names, const size_t size)
+    {
+        m_size = size;
+        includes(names);
+
+        while (m_out.size() + 512 < size) function(false);
+        function(true);
+    }
+
+    // Rows of numbers set on the module, as generated data (2da lookups, experience tables, loot odds) ends up.
+    void Writer::table(const size_t size)
+    {
+        m_out += "// Generated table; do not edit.\n\nvoid main()\n{\n    object oModule = GetModule();\n";
+
+        for (int row = 0; m_out.size() < size; ++row)
+        {
+            comments(1);
+
+            const bool floats = m_random.chance(30);
+            const int columns = m_random.between(4, 12);
+
+            for (int column = 0; column < columns; ++column)
+            {
+                m_out += floats ? "    SetLocalFloat(oModule, \"tbl_" : "    SetLocalInt(oModule, \"tbl_";
+                m_out += std::to_string(row);
+                m_out += '_';
+                m_out += std::to_string(column);
+                m_out += "\", ";
+                if (floats) float_literal();
+                else int_literal();
+                m_out += ");\n";
+            }
+        }
+
+        m_out += "}\n";
+    }
+
+    void Writer::includes(const std::vector<std::string>& names)
+    {
+        for (const std::string& name : names)
+        {
+            m_out += "#include \"";
+            m_out += name;
+            m_out += "\"\n";
+        }
+
+        if (!names.empty()) m_out += '\n';
+    }
+
+    void Writer::function(const bool is_main)
+    {
+        comments(0);
+
+        if (is_main)
+        {
+            m_out += "void main()\n";
+        }
+        else
+        {
+            m_out += m_random.chance(40) ? "void" : m_random.pick(types);
+            m_out += ' ';
+            name("");
+            m_out += '(';
+
+            const int params = m_random.between(0, 4);
+            for (int i = 0; i < params; ++i)
+            {
+                if (i) m_out += ", ";
+                m_out += m_random.pick(types);
+                m_out += ' ';
+                name(m_random.pick(prefixes));
+            }
+
+            m_out += ")\n";
+        }
+
+        block(0);
+        m_out += '\n';
+    }
+
+    void Writer::block(const int depth)
+    {
+        indent(depth);
+        m_out += "{\n";
+
+        // A function stops early once the file is big enough, so small files come out small.
+        const int statements = depth == 0 ? m_random.between(4, 16) : m_random.between(1, 4);
+        for (int i = 0; i < statements && (i == 0 || depth > 0 || m_out.size() < m_size); ++i) statement(depth + 1);
+
+        indent(depth);
+        m_out += "}\n";
+    }
+
+    void Writer::statement(const int depth)
+    {
+        comments(depth);
+
+        indent(depth);
+
+        // Control flow nests no deeper than real scripts tend to.
+        if (depth < 5 && m_random.chance(m_mix.keywords))
+        {
+            switch (m_random.below(6))
+            {
+                case 0:
+                case 1:
+                    m_out += "if (";
+                    expression(0);
+                    m_out += ")\n";
+                    block(depth);
+
+                    if (m_random.chance(40))
+                    {
+                        indent(depth);
+                        m_out += "else\n";
+                        block(depth);
+                    }
+                    return;
+
+                case 2:
+                    m_out += "while (";
+                    expression(0);
+                    m_out += ")\n";
+                    block(depth);
+                    return;
+
+                case 3:
+                    m_out += "for (nIndex = 0; nIndex < ";
+                    int_literal();
+                    m_out += "; ++nIndex)\n";
+                    block(depth);
+                    return;
+
+                case 4:
+                {
+                    m_out += "switch (";
+                    expression(1);
+                    m_out += ")\n";
+                    indent(depth);
+                    m_out += "{\n";
+
+                    const int cases = m_random.between(2, 6);
+                    for (int i = 0; i < cases; ++i)
+                    {
+                        indent(depth + 1);
+                        m_out += "case ";
+                        m_out += std::to_string(i);
+                        m_out += ":\n";
+                        statement(depth + 2);
+                        indent(depth + 2);
+                        m_out += "break;\n";
+                    }
+
+                    indent(depth);
+                    m_out += "}\n";
+                    return;
+                }
+
+                default:
+                    m_out += "return";
+                    if (m_random.chance(50))
+                    {
+                        m_out += ' ';
+                        expression(0);
+                    }
+                    m_out += ";\n";
+                    return;
+            }
+        }
+
+        switch (m_random.below(3))
+        {
+            case 0:
+                m_out += m_random.pick(types);
+                m_out += ' ';
+                name(m_random.pick(prefixes));
+                m_out += " = ";
+                break;
+
+            case 1:
+                name(m_random.pick(prefixes));
+                m_out += ' ';
+                m_out += m_random.pick(assign_ops);
+                m_out += ' ';
+                break;
+
+            default:
+                call(0);
+                m_out += ";\n";
+                return;
+        }
+
+        expression(0);
+        m_out += ";\n";
+    }
+
+    void Writer::expression(const int depth)
+    {
+        if (depth < 3 && m_random.chance(45))
+        {
+            const bool parens = m_random.chance(30);
+            if (parens) m_out += '(';
+            expression(depth + 1);
+            m_out += ' ';
+            m_out += m_random.pick(binary_ops);
+            m_out += ' ';
+            expression(depth + 1);
+            if (parens) m_out += ')';
+            return;
+        }
+
+        if (depth < 3 && m_random.chance(25)) call(depth + 1);
+        else operand();
+    }
+
+    void Writer::operand()
+    {
+        if (m_random.chance(m_mix.identifiers))
+        {
+            name(m_random.pick(prefixes));
+            return;
+        }
+
+        switch (m_random.below(4))
+        {
+            case 0: string_literal(); break;
+            case 1: float_literal(); break;
+            default: int_literal(); break;
+        }
+    }
+
+    void Writer::call(const int depth)
+    {
+        m_out += m_random.pick(functions);
+        m_out += '(';
+
+        const int args = m_random.between(0, 3);
+        for (int i = 0; i < args; ++i)
+        {
+            if (i) m_out += ", ";
+            if (depth < 3) expression(depth + 1);
+            else operand();
+        }
+
+        m_out += ')';
+    }
+
+    void Writer::string_literal()
+    {
+        m_out += '"';
+
+        // Long ones are dialogue and journal text: sentences, with the odd escape.
+        const int count = m_random.chance(m_mix.strings) ? m_random.between(40, 400) : m_random.between(1, 4);
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (i) m_out += m_random.chance(3) ? "\\n" : m_random.chance(2) ? " \\\"" : " ";
+            m_out += m_random.pick(words);
+        }
+
+        m_out += '"';
+    }
+
+    void Writer::int_literal()
+    {
+        switch (m_random.below(8))
+        {
+            case 0:
+            {
+                char text[16];
+                snprintf(text, sizeof(text), "0x%X", (unsigned)m_random.below(1 << 24));
+                m_out += text;
+                break;
+            }
+
+            case 1: m_out += std::to_string(m_random.below(1000000)); break;
+            default: m_out += std::to_string(m_random.below(100)); break;
+        }
+    }
+
+    void Writer::float_literal()
+    {
+        m_out += std::to_string(m_random.below(1000));
+        m_out += '.';
+        m_out += std::to_string(m_random.below(1000));
+        m_out += m_random.chance(70) ? "f" : "";
+    }
+
+    void Writer::name(const char* prefix)
+    {
+        m_out += prefix;
+        m_out += m_random.pick(stems);
+        if (m_random.chance(50)) m_out += m_random.pick(stems);
+        if (m_random.chance(30)) m_out += std::to_string(m_random.below(100));
+    }
+
+    // As many comments as bring the file up to its share of them.
+    void Writer::comments(const int depth)
+    {
+        while (m_comment_bytes * 100 < m_out.size() * (size_t)m_mix.comments)
+        {
+            indent(depth);
+            comment();
+        }
+    }
+
+    void Writer::comment()
+    {
+        const size_t start = m_out.size();
+        const bool block_comment = m_random.chance(25);
+        const int count = m_random.between(3, block_comment ? 40 : 12);
+
+        m_out += block_comment ? "/* " : "// ";
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (i) m_out += block_comment && i % 10 == 0 ? "\n   " : " ";
+            m_out += m_random.pick(words);
+        }
+
+        m_out += block_comment ? " */\n" : "\n";
+        m_comment_bytes += m_out.size() - start;
+    }
+
+    void Writer::indent(const int depth)
+    {
+        m_out.append((size_t)depth * 4, ' ');
+    }
+
+    bool parse_size(const char* text, uint64_t* size)
+    {
+        char* end;
+        const unsigned long long value = strtoull(text, &end, 10);
+        if (end == text) return false;
+
+        int shift = 0;
+        if (*end == 'K' || *end == 'k') shift = 10;
+        else if (*end == 'M' || *end == 'm') shift = 20;
+        else if (*end == 'G' || *end == 'g') shift = 30;
+        else if (*end) return false;
+
+        if (shift && end[1]) return false;
+
+        *size = (uint64_t)value << shift;
+        return true;
+    }
+
+    bool write_file(const std::filesystem::path& path, const std::string& data)
+    {
+        FILE* file = fopen(path.string().c_str(), "wb");
+        bool written = file && fwrite(data.data(), 1, data.size(), file) == data.size();
+        written = file && fclose(file) == 0 && written;
+
+        if (!written) printf("ERROR: %s: could not be written\n", path.string().c_str());
+        return written;
+    }
+
+    std::string header_name(const int level, const int idx)
+    {
+        return "inc_" + std::to_string(level + 1) + "_" + std::to_string(idx);
+    }
+}
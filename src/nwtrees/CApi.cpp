@@ -0,0 +1,187 @@
+#include <nwtrees/CApi.h>
+#include <nwtrees/Lexer.hpp>
+
+#include <climits>
+#include <cstring>
+#include <new>
+#include <string>
+
+using namespace nwtrees;
+
+static_assert(NWTREES_KIND_IDENTIFIER == token_kind::identifier);
+static_assert(NWTREES_KIND_STRING == token_kind::of(Literal::String));
+static_assert(NWTREES_KIND_INT == token_kind::of(Literal::Int));
+static_assert(NWTREES_KIND_FLOAT == token_kind::of(Literal::Float));
+static_assert(NWTREES_ERROR_INVALID_CHARACTER == Error::InvalidCharacter);
+static_assert(NWTREES_ERROR_UNTERMINATED_STRING == Error::UnterminatedString);
+static_assert(NWTREES_ERROR_INVALID_NUMBER == Error::InvalidNumber);
+
+// Lexes through a LexerStream into an output that only ever holds names and errors, with room for the most of both
+// any source it takes could need, so lexing never grows it.
+struct nwtrees_lexer
+{
+    LexerOutput output;
+    LexerOptions options;
+    size_t max_source_size;
+};
+
+namespace
+{
+    void reserve(nwtrees_lexer& lexer);
+    void write_token(const Token& token, int offset, const LexerOutput& output, nwtrees_buffers& buffers);
+}
+
+nwtrees_lexer* nwtrees_lexer_create(const size_t max_source_size, const int32_t max_errors)
+{
+    if (max_source_size > INT_MAX || max_errors < 1) return nullptr;
+
+    nwtrees_lexer* lexer = new (std::nothrow) nwtrees_lexer;
+    if (!lexer) return nullptr;
+
+    // Names stay in the source, but for merged string literals; errors stop at the limit.
+    lexer->options.source_names = true;
+    lexer->options.recover = max_errors > 1;
+    lexer->options.max_errors = max_errors;
+    lexer->max_source_size = max_source_size;
+
+    try
+    {
+        reserve(*lexer);
+    }
+    catch (...)
+    {
+        delete lexer;
+        return nullptr;
+    }
+
+    return lexer;
+}
+
+void nwtrees_lexer_destroy(nwtrees_lexer* const lexer)
+{
+    delete lexer;
+}
+
+nwtrees_status nwtrees_lex(nwtrees_lexer* const lexer, const char* const source, const size_t size, nwtrees_buffers* const buffers)
+{
+    if (!lexer || !buffers || (!source && size)) return NWTREES_INVALID_ARGUMENT;
+    if (size > lexer->max_source_size) return NWTREES_SOURCE_TOO_LARGE;
+
+    LexerOutput& output = lexer->output;
+    output.names.clear();
+    output.errors.clear();
+    output.diagnostics.clear();
+
+    buffers->token_count = 0;
+    buffers->name_count = 0;
+    buffers->error_count = 0;
+
+    // Nothing here should throw, with everything reserved; but nothing may escape to C either way.
+    try
+    {
+        LexerStream stream(std::string_view(size ? source : "", size), output, lexer->options);
+        Token token;
+
+        while (stream.next(&token)) write_token(token, stream.offset(), output, *buffers);
+    }
+    catch (...)
+    {
+        return NWTREES_OUT_OF_MEMORY;
+    }
+
+    for (size_t i = 0; i < output.errors.size() && i < buffers->error_capacity; ++i)
+    {
+        buffers->errors[i] = { (int32_t)output.errors[i].code, output.errors[i].offset };
+    }
+
+    buffers->error_count = output.errors.size();
+
+    if (buffers->token_count > buffers->token_capacity || buffers->name_count > buffers->name_capacity ||
+        buffers->error_count > buffers->error_capacity)
+    {
+        return NWTREES_NEEDS_SPACE;
+    }
+
+    return output.errors.empty() ? NWTREES_OK : NWTREES_LEX_ERRORS;
+}
+
+const char* nwtrees_kind_name(const uint8_t kind)
+{
+    switch (kind < token_kind::count ? token_kind::type(kind) : Token::EnumCount)
+    {
+        case Token::Identifier: return "identifier";
+        case Token::Keyword: return keywords[kind - token_kind::first_keyword].first.data();
+        case Token::Punctuator: return punctuators[kind - token_kind::first_punctuator].first.data();
+        case Token::Literal:
+        {
+            static constexpr const char* literals[] = { "string literal", "int literal", "float literal" };
+            return literals[kind - token_kind::first_literal];
+        }
+        default: return nullptr;
+    }
+}
+
+const char* nwtrees_describe_error(const int32_t code)
+{
+    return Error::describe((Error::Code)code);
+}
+
+namespace
+{
+    void reserve(nwtrees_lexer& lexer)
+    {
+        LexerOutput& output = lexer.output;
+
+        // Merged string literals are the only names copied, and can't come to more than the source they're from.
+        output.names.reserve(lexer.max_source_size);
+        output.errors.reserve(lexer.options.max_errors);
+
+        // The invalid character messages are interned as they're met, so every one there could be is met here first.
+        // Clearing the table afterwards keeps its storage, which then has room for whichever a source brings.
+        std::string every_byte;
+        for (int ch = 0; ch < 256; ++ch)
+        {
+            every_byte += (char)ch;
+            every_byte += '\n';
+        }
+
+        LexerOptions options;
+        options.recover = true;
+
+        LexerStream stream(every_byte, output, options);
+        Token token;
+        while (stream.next(&token)) { }
+
+        output.names.clear();
+        output.errors.clear();
+        output.diagnostics.clear();
+    }
+
+    void write_token(const Token& token, const int offset, const LexerOutput& output, nwtrees_buffers& buffers)
+    {
+        nwtrees_token out;
+        out.kind = token_kind::of(token);
+        out.offset = offset;
+
+        if (token.type == Token::Identifier || (token.type == Token::Literal && token.literal == Literal::String))
+        {
+            const std::string_view text = output.text(token.type == Token::Identifier ? token.identifier_data : token.literal_data.str);
+            out.value.name = { (int32_t)buffers.name_count, (int32_t)text.size() };
+
+            if (buffers.name_count + text.size() <= buffers.name_capacity) std::memcpy(buffers.names + buffers.name_count, text.data(), text.size());
+            buffers.name_count += text.size();
+        }
+        else if (token.type == Token::Literal)
+        {
+            if (token.literal == Literal::Int) out.value.integer = token.literal_data.integer;
+            else out.value.flt = token.literal_data.flt;
+        }
+        else
+        {
+            out.value.integer = 0;
+        }
+
+        if (buffers.token_count < buffers.token_capacity) buffers.tokens[buffers.token_count] = out;
+        ++buffers.token_count;
+    }
+}
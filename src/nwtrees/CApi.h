@@ -0,0 +1,99 @@
+#pragma once
+
+/* The lexer, from C, for hosts that can't have it allocate or throw at the wrong moment: a plugin compiling scripts inside
+ * a game server, between ticks. Everything a lexer needs is allocated when it is created, for sources up to a given size.
+ * After that, nwtrees_lex only writes to the buffers it is given, and never allocates, throws or prints; when they are
+ * too small, it says how big they need to be instead. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct nwtrees_lexer nwtrees_lexer;
+
+typedef enum nwtrees_status
+{
+    NWTREES_OK,
+    NWTREES_LEX_ERRORS, /* lexed, with errors; they are in the error buffer */
+    NWTREES_NEEDS_SPACE, /* a buffer was too small; the counts are how big each needs to be */
+    NWTREES_SOURCE_TOO_LARGE, /* larger than the lexer was created for */
+    NWTREES_INVALID_ARGUMENT,
+    NWTREES_OUT_OF_MEMORY,
+} nwtrees_status;
+
+/* What a token is: an identifier, then every keyword, the three literals and every punctuator, as nwtrees::TokenKind. */
+#define NWTREES_KIND_IDENTIFIER 0
+#define NWTREES_KIND_STRING 27
+#define NWTREES_KIND_INT 28
+#define NWTREES_KIND_FLOAT 29
+
+/* As nwtrees::Error::Code. */
+#define NWTREES_ERROR_UNKNOWN 0
+#define NWTREES_ERROR_INVALID_CHARACTER 1
+#define NWTREES_ERROR_UNTERMINATED_STRING 2
+#define NWTREES_ERROR_INVALID_NUMBER 3
+
+/* A range of nwtrees_buffers::names. */
+typedef struct nwtrees_name
+{
+    int32_t idx;
+    int32_t len;
+} nwtrees_name;
+
+typedef struct nwtrees_token
+{
+    uint8_t kind;
+    int32_t offset; /* into the source, of the token's first character */
+
+    union
+    {
+        nwtrees_name name; /* identifiers and strings */
+        int32_t integer;
+        float flt;
+    } value;
+} nwtrees_token;
+
+typedef struct nwtrees_error
+{
+    int32_t code;
+    int32_t offset; /* into the source */
+} nwtrees_error;
+
+/* The caller's storage for one source's tokens, names and errors. Names (of identifiers, and strings with their quotes
+ * taken off and adjacent ones merged) are copied, so the tokens don't need the source once it is lexed. */
+typedef struct nwtrees_buffers
+{
+    nwtrees_token* tokens;
+    size_t token_capacity;
+    char* names;
+    size_t name_capacity; /* bytes */
+    nwtrees_error* errors;
+    size_t error_capacity;
+
+    /* Set by nwtrees_lex: how many the source has, whether or not they fit. */
+    size_t token_count;
+    size_t name_count;
+    size_t error_count;
+} nwtrees_buffers;
+
+/* A lexer for sources of up to max_source_size bytes, which carries on past errors until it has found max_errors of them
+ * (1 stops at the first). Returns null if either is out of range, or on running out of memory. */
+nwtrees_lexer* nwtrees_lexer_create(size_t max_source_size, int32_t max_errors);
+void nwtrees_lexer_destroy(nwtrees_lexer* lexer);
+
+/* Lexes size bytes of source into buffers. Nothing is written past any buffer's capacity, and what is written is only
+ * complete if this returns NWTREES_OK or NWTREES_LEX_ERRORS. One lexer lexes one source at a time. */
+nwtrees_status nwtrees_lex(nwtrees_lexer* lexer, const char* source, size_t size, nwtrees_buffers* buffers);
+
+/* How a token kind is spelled, for keywords and punctuators, or what it is, for the rest. Null if it isn't a kind. */
+const char* nwtrees_kind_name(uint8_t kind);
+
+/* What an error code means, such as "unterminated string". */
+const char* nwtrees_describe_error(int32_t code);
+
+#ifdef __cplusplus
+}
+#endif
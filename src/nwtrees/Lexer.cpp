@@ -1,9 +1,24 @@
 #include <nwtrees/Lexer.hpp>
 #include <nwtrees/util/Assert.hpp>
+#include <nwtrees/util/Scan.hpp>
 
 #include <algorithm>
+#include <charconv>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdio.h>
 #include <string_view>
-#include <unordered_map>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#else
+    #include <chrono>
+#endif
 
 using namespace nwtrees;
 
@@ -11,24 +26,49 @@ namespace
 {
     void prepare_output(LexerOutput& output);
 
+    // Whether Config compiles a feature in and options asks for it. What a config leaves out is constant false,
+    // so each check, and whatever it guards, folds away in that config's lexer.
+    template <typename Config> bool interns(const LexerOptions& options) { return Config::intern_names && options.intern_names; }
+    template <typename Config> bool recovers(const LexerOptions& options) { return Config::recover && options.recover; }
+    template <typename Config> bool records_directives(const LexerOptions& options) { return Config::directives && options.directives; }
+    template <typename Config> bool uses_arrays(const LexerOptions& options) { return Config::arrays && options.layout == TokenLayout::Arrays; }
+
+    template <typename Config = LexerConfig>
+    bool names_in_source(const LexerOptions& options);
+
+    // options, less whatever Config leaves out, so that nothing outside the lexer's loop asks for it either.
+    template <typename Config>
+    LexerOptions configured(const LexerOptions& options);
+
     struct LexerInput
     {
         const char* base;
         const char* head() const { return base + offset; }
+        const char* end() const { return base + length; }
         int offset;
+        int length;
     };
 
-    char seek(LexerInput& input);
-
-    struct DebugRange
+    // The batch lexer is compiled once recording into a LexerStats (with CountStats), and once with NoStats,
+    // whose members do nothing and are compiled out.
+    struct NoStats
     {
-        int line;
-        int index_start;
-        int index_end;
+        void skipped_whitespace(int) { }
+        void skipped_comment(int) { }
+        void skipped_preprocessor(int) { }
+        void lexed(const Token&) { }
+        void merged_string() { }
+
+        uint64_t now() { return 0; }
+        uint64_t seek_done(uint64_t) { return 0; }
+        uint64_t tokenize_done(uint64_t) { return 0; }
     };
 
-    std::vector<DebugRange> make_debug_ranges(const char* data);
-    const DebugRange& find_debug_range(const std::vector<DebugRange>& ranges, const LexerInput& input);
+    struct CountStats;
+
+    template <typename Stats>
+    bool seek(LexerInput& input, std::pmr::vector<Directive>* directives, Stats& stats);
+    void record_directive(const LexerInput& input, const char* end, std::pmr::vector<Directive>& directives);
 
     struct LexerMatch
     {
@@ -36,49 +76,369 @@ namespace
         int length;
     };
 
-    bool tokenize_keyword(const LexerInput& input, LexerMatch* match);
+    // The first character of a token is enough to decide which tokenizer can match it.
+    enum class CharClass : uint8_t
+    {
+        Invalid,
+        Whitespace,
+        Letter, // keyword or identifier
+        Digit, // numeric literal
+        Quote, // string literal
+        Sign, // numeric literal or punctuator
+        Dot, // numeric literal or punctuator
+        Punctuator,
+    };
+
+    constexpr std::array<CharClass, 256> make_char_classes()
+    {
+        std::array<CharClass, 256> classes = {};
+
+        for (const char ch : std::string_view(" \t\v\f\r\n")) classes[(uint8_t)ch] = CharClass::Whitespace;
+        for (int ch = 'a'; ch <= 'z'; ++ch) classes[ch] = CharClass::Letter;
+        for (int ch = 'A'; ch <= 'Z'; ++ch) classes[ch] = CharClass::Letter;
+        for (int ch = '0'; ch <= '9'; ++ch) classes[ch] = CharClass::Digit;
+        for (const auto& [str, _] : punctuators) classes[(uint8_t)str[0]] = CharClass::Punctuator;
+
+        classes['_'] = CharClass::Letter;
+        classes['\"'] = CharClass::Quote;
+        classes['+'] = CharClass::Sign;
+        classes['-'] = CharClass::Sign;
+        classes['.'] = CharClass::Dot;
+
+        return classes;
+    }
+
+    static constexpr std::array<CharClass, 256> char_classes = make_char_classes();
+
+    // -- Keywords are found with a perfect hash of their first two characters, last character and length,
+    // made from the keywords array at compile time: any identifier costs one hash, one load and one compare.
+
+    static constexpr int keyword_table_bits = 6;
+
+    constexpr uint32_t keyword_hash(const char* str, const int len, const uint32_t seed)
+    {
+        const uint32_t key = (uint32_t)(uint8_t)str[0] | (uint32_t)(uint8_t)str[1] << 8 | (uint32_t)(uint8_t)str[len - 1] << 16 | (uint32_t)len << 24;
+        return (key * seed) >> (32 - keyword_table_bits);
+    }
+
+    struct KeywordTable
+    {
+        uint32_t seed = 0;
+        int min_len = 0;
+        int max_len = 0;
+        std::array<uint8_t, 1 << keyword_table_bits> slots = {}; // Keyword + 1, or 0 if no keyword hashes here
+    };
+
+    // Tries multipliers until one sends every keyword to a slot of its own.
+    constexpr KeywordTable make_keyword_table()
+    {
+        KeywordTable table;
+        table.min_len = (int)keywords[0].first.size();
+
+        for (const auto& [str, _] : keywords)
+        {
+            table.min_len = std::min(table.min_len, (int)str.size());
+            table.max_len = std::max(table.max_len, (int)str.size());
+        }
+
+        for (uint32_t attempt = 1; attempt < 100000; ++attempt)
+        {
+            table.seed = (attempt * 0x9E3779B9u) | 1;
+            table.slots = {};
+
+            bool perfect = true;
+
+            for (size_t i = 0; perfect && i < keywords.size(); ++i)
+            {
+                uint8_t& slot = table.slots[keyword_hash(keywords[i].first.data(), (int)keywords[i].first.size(), table.seed)];
+                perfect = slot == 0;
+                slot = (uint8_t)(i + 1);
+            }
+
+            if (perfect) return table;
+        }
+
+        table.seed = 0;
+        return table;
+    }
+
+    static constexpr KeywordTable keyword_table = make_keyword_table();
+    static_assert(keyword_table.seed != 0, "no perfect hash for the keywords; widen keyword_table_bits");
+    static_assert(keyword_table.min_len >= 2, "keyword_hash reads the first two characters");
+
+    bool find_keyword(const char* str, int len, Keyword* keyword);
+
+    // -- Punctuators are matched by a maximal-munch DFA over the punctuators array, also made at compile time.
+    // Its states are the prefixes of punctuators, and a stopped twin of each: where the prefix goes once the next character
+    // can't extend it. A stopped state knows the longest punctuator that the input starts with, so matching is taking
+    // transitions until one lands on a stopped state, at most one per character of the longest punctuator.
+
+    static constexpr int punctuator_dfa_max_nodes = 64;
+    static constexpr int punctuator_dfa_max_classes = 32;
+
+    struct PunctuatorDfa
+    {
+        int node_count = 1; // node 0 is the empty prefix; node n's stopped twin is node_count + n
+        int class_count = 1; // class 0 is every byte that is in no punctuator
+
+        std::array<uint8_t, 256> classes = {};
+        std::array<std::array<uint8_t, punctuator_dfa_max_classes>, punctuator_dfa_max_nodes * 2> next = {};
+
+        // Punctuator + 1 for the longest punctuator that is a prefix of the state's, or 0 if none is; and its length.
+        std::array<uint8_t, punctuator_dfa_max_nodes * 2> longest = {};
+        std::array<uint8_t, punctuator_dfa_max_nodes * 2> longest_len = {};
+    };
+
+    constexpr PunctuatorDfa make_punctuator_dfa()
+    {
+        PunctuatorDfa dfa;
+
+        for (const auto& [str, _] : punctuators)
+        {
+            for (const char ch : str)
+            {
+                if (!dfa.classes[(uint8_t)ch]) dfa.classes[(uint8_t)ch] = (uint8_t)dfa.class_count++;
+            }
+        }
+
+        // The trie of punctuators first. No edge leads back to node 0, so 0 marks a missing one.
+        std::array<std::array<uint8_t, punctuator_dfa_max_classes>, punctuator_dfa_max_nodes> children = {};
+        std::array<uint8_t, punctuator_dfa_max_nodes> accepts = {};
+        std::array<bool, punctuator_dfa_max_nodes> has_children = {};
+
+        for (size_t i = 0; i < punctuators.size(); ++i)
+        {
+            int node = 0;
+
+            for (const char ch : punctuators[i].first)
+            {
+                uint8_t& child = children[node][dfa.classes[(uint8_t)ch]];
+                if (!child) child = (uint8_t)dfa.node_count++;
+                has_children[node] = true;
+                node = child;
+            }
+
+            accepts[node] = (uint8_t)(i + 1);
+        }
+
+        // Every node is made after its parent, so one pass in that order settles the longest match for all of them.
+        for (int node = 0; node < dfa.node_count; ++node)
+        {
+            const int stopped = dfa.node_count + node;
+
+            for (int cls = 0; cls < punctuator_dfa_max_classes; ++cls)
+            {
+                const int child = children[node][cls];
+                if (child) dfa.longest[child] = accepts[child] ? accepts[child] : dfa.longest[node];
+
+                // Nothing extends a leaf, so it is stopped as soon as it is reached.
+                dfa.next[node][cls] = (uint8_t)(!child ? stopped : has_children[child] ? child : dfa.node_count + child);
+                dfa.next[stopped][cls] = (uint8_t)stopped;
+            }
+
+            dfa.longest[stopped] = dfa.longest[node];
+        }
+
+        for (int state = 0; state < dfa.node_count * 2; ++state)
+        {
+            if (dfa.longest[state]) dfa.longest_len[state] = (uint8_t)punctuators[dfa.longest[state] - 1].first.size();
+        }
+
+        return dfa;
+    }
+
+    static constexpr PunctuatorDfa punctuator_dfa = make_punctuator_dfa();
+
+    enum class LexResult
+    {
+        Token,
+        End,
+        Error,
+    };
+
     bool tokenize_identifier(const LexerInput& input, LexerMatch* match);
     bool tokenize_literal(const LexerInput& input, LexerMatch* match);
     bool tokenize_punctuator(const LexerInput& input, LexerMatch* match);
 
-    inline char read(const LexerInput& input) { return input.base[input.offset]; }
-    inline char peek(const LexerInput& input, int count = 1) { return input.base[input.offset + count]; }
+    template <typename Config, typename Stats>
+    void merge_string_literals(LexerInput& input, LexerOutput& output, const LexerOptions& options, SymbolTable& symbols, Token* token, Stats& stats);
+
+    int record_error(const LexerInput& input, LexerOutput& output);
 
-    template <typename ... Args>
-    inline int skip_until(const char* tail, const Args ... terms)
+    template <typename Config, typename Stats>
+    LexResult lex_token(LexerInput& input, LexerOutput& output, const LexerOptions& options, SymbolTable& symbols, Token* token, int* offset, Stats& stats);
+
+    template <typename Config, typename Stats>
+    void lex_all(std::string_view data, LexerOutput& output, const LexerOptions& options, Stats& stats);
+
+    NameBufferEntry* name_entry(Token& token, const LexerOptions& options);
+
+    // A piece of a large source, lexed on a thread of its own from a line start that may not be a token boundary.
+    struct LexerChunk
+    {
+        int begin;
+        int end; // Tokens starting here or later are the next chunk's.
+
+        // Lexed into output, unless into is set. Only the chunk lexed on the caller's own thread is lexed into the caller's
+        // output, so the output's memory resource doesn't have to be thread-safe.
+        LexerOutput output;
+        LexerOutput* into = nullptr;
+
+        // Where the lexer got to: before the first token at or past end (result is Token), or wherever it finished.
+        int resume;
+        LexResult result;
+    };
+
+    void lex_chunk(std::string_view data, const LexerOptions& options, LexerChunk* chunk);
+    void lex_chunks(std::string_view data, LexerOutput& output, const LexerOptions& options, int count);
+    void adopt_token(Token token, int offset, const LexerOutput& from, LexerOutput& output, const LexerOptions& options, SymbolTable& symbols);
+    void adopt_chunk(const LexerOutput& from, size_t first, LexerOutput& output, const LexerOptions& options, SymbolTable& symbols);
+
+    // Reading past the end of the input yields '\0', which no tokenizer accepts.
+    inline char read(const LexerInput& input) { return input.offset < input.length ? input.base[input.offset] : '\0'; }
+    inline char peek(const LexerInput& input, int count = 1) { return input.offset + count < input.length ? input.base[input.offset + count] : '\0'; }
+
+    inline void advance_to(LexerInput& input, const char* head) { input.offset = (int)(head - input.base); }
+
+    inline CharClass classify(const char ch) { return char_classes[(uint8_t)ch]; }
+    inline bool is_whitespace(const char ch) { return classify(ch) == CharClass::Whitespace; }
+    inline bool is_identifier_char(const char ch) { return classify(ch) == CharClass::Letter || classify(ch) == CharClass::Digit; }
+    inline bool is_digit(const char ch) { return classify(ch) == CharClass::Digit; }
+    inline bool is_digit_hex(const char ch) { return is_digit(ch) || (ch >= 'A' && ch <= 'F') || (ch >= 'a' && ch <= 'f'); }
+
+    inline int digit_value(const char ch) { return is_digit(ch) ? ch - '0' : (ch | 0x20) - 'a' + 10; }
+
+    // Digits past this are only counted as overflow; it is one past the magnitude of the largest long, which is 64 bits
+    // on LP64 and 32 on Windows, as it was when strtol parsed ints.
+    static constexpr uint64_t magnitude_limit = (uint64_t)LONG_MAX + 1;
+
+    inline uint64_t accumulate_digit(const uint64_t magnitude, const int base, const int digit)
     {
-        static constexpr auto contains =
-            [](const auto first, const auto... args) -> bool
+        return magnitude > (magnitude_limit - digit) / base ? magnitude_limit : magnitude * base + digit;
+    }
+
+    inline int64_t saturate(const uint64_t magnitude, const bool negative)
+    {
+        if (negative) return magnitude >= magnitude_limit ? LONG_MIN : -(int64_t)magnitude;
+        return magnitude >= magnitude_limit ? LONG_MAX : (int64_t)magnitude;
+    }
+
+    // Whether a float that is out of range for a double is out of range because it is too large, rather than too small.
+    // Either way it is far from 1, so the sign of its decimal exponent is enough to tell.
+    bool is_overflow(const char* head, const char* end)
+    {
+        int exponent = 0;
+        bool seen_digit = false;
+        bool seen_decimal = false;
+
+        for (; head < end && *head != 'e' && *head != 'f'; ++head)
         {
-            return ((first == args) || ...);
-        };
+            if (*head == '.') seen_decimal = true;
+            else if (!is_digit(*head)) continue;
+            else if (seen_digit) exponent += !seen_decimal;
+            else if (*head != '0') { seen_digit = true; exponent += !seen_decimal; }
+            else exponent -= seen_decimal;
+        }
+
+        if (head < end && *head == 'e')
+        {
+            const bool negative = ++head < end && *head == '-';
+            if (head < end && (*head == '-' || *head == '+')) ++head;
+
+            int written = 0;
+            for (; head < end && is_digit(*head); ++head) written = std::min(written * 10 + (*head - '0'), 1000000);
+            exponent += negative ? -written : written;
+        }
 
-        const char* head = tail;
-        while (const char ch = *head) { if (contains(ch, terms ...)) break; ++head; }
-        return (int)(head - tail);
+        return exponent > 0;
     }
 
-    inline bool cmp(const LexerMatch& lhs, const LexerMatch& rhs) { return lhs.length > rhs.length; }
-    inline bool is_whitespace(const char ch) { return ch == ' ' || ch == '\t' || ch == '\v' || ch == '\f' || ch == '\r' || ch == '\n'; }
-    inline bool is_letter(const char ch) { return (ch >= 'A' && ch <= 'Z') || ch >= 'a' && ch <= 'z'; }
-    inline bool is_digit(const char ch) { return ch >= '0' && ch <= '9'; }
-    inline bool is_digit_hex(const char ch) { return is_digit(ch) || (ch >= 'A' && ch <= 'F') || ch >= 'a' && ch <= 'f'; }
+    // A number must be followed by whitespace or something that starts a punctuator,
+    // which is any byte that the punctuator DFA doesn't stop at straight away.
+    inline bool is_number_terminator(const char ch)
+    {
+        return is_whitespace(ch) || punctuator_dfa.next[0][punctuator_dfa.classes[(uint8_t)ch]] != punctuator_dfa.node_count;
+    }
 
     void prepare_output(LexerOutput& output)
     {
         output.tokens.clear();
         output.names.clear();
         output.errors.clear();
+        output.offsets.clear();
+        output.kinds.clear();
+        output.payloads.clear();
+        output.symbols.clear();
+        output.diagnostics.clear();
+        output.directives.clear();
+        output.source = std::string_view();
+    }
+
+    template <typename Config>
+    bool names_in_source(const LexerOptions& options)
+    {
+        return Config::source_names && options.source_names && !interns<Config>(options);
+    }
+
+    template <typename Config>
+    LexerOptions configured(const LexerOptions& options)
+    {
+        LexerOptions result = options;
+        result.intern_names = interns<Config>(options);
+        result.recover = recovers<Config>(options);
+        result.directives = records_directives<Config>(options);
+        result.source_names = Config::source_names && options.source_names;
+        if (!uses_arrays<Config>(options)) result.layout = TokenLayout::Structs;
+        return result;
+    }
+
+    uint64_t read_cycle_counter()
+    {
+    #if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+    #else
+        return (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+    #endif
     }
 
-    char seek(LexerInput& input)
+    struct CountStats
+    {
+        LexerStats& stats;
+
+        void skipped_whitespace(const int bytes) { stats.whitespace_bytes += bytes; }
+        void skipped_comment(const int bytes) { stats.comment_bytes += bytes; }
+        void skipped_preprocessor(const int bytes) { stats.preprocessor_bytes += bytes; }
+
+        void lexed(const Token& token)
+        {
+            ++stats.tokens_by_type[token.type];
+            ++stats.tokens_by_kind[token_kind::of(token)];
+        }
+
+        void merged_string() { ++stats.strings_merged; }
+
+        uint64_t now() { return stats.count_cycles ? read_cycle_counter() : 0; }
+
+        // Each adds the time since start, and returns the end of it.
+        uint64_t seek_done(const uint64_t start) { const uint64_t end = now(); stats.seek_cycles += end - start; return end; }
+        uint64_t tokenize_done(const uint64_t start) { const uint64_t end = now(); stats.tokenize_cycles += end - start; return end; }
+    };
+
+    template <typename Stats>
+    bool seek(LexerInput& input, std::pmr::vector<Directive>* directives, Stats& stats)
     {
-        while (const char ch = read(input))
+        while (input.offset < input.length)
         {
-            // For now, we completely skip the preprocessor.
+            const char ch = read(input);
+            const int start = input.offset;
+
+            // Preprocessor lines produce no tokens; the preprocessor gets the ones it acts on as directives.
             if (ch == '#')
             {
-                input.offset += skip_until(input.head(), '\n');
+                const char* line_end = scan::find_newline(input.head(), input.end());
+                if (directives) record_directive(input, line_end, *directives);
+                advance_to(input, line_end);
+                stats.skipped_preprocessor(input.offset - start);
             }
             // We skip past comments.
             else if (ch == '/')
@@ -88,145 +448,122 @@ namespace
                 // C++-style comment: skip to end of line.
                 if (peek_ch == '/')
                 {
-                    input.offset += skip_until(input.head(), '\n');
+                    advance_to(input, scan::find_newline(input.head(), input.end()));
                 }
                 // C-style comment: skip to matching symbol.
                 else if (peek_ch == '*')
                 {
-                    while (read(input))
-                    {
-                        input.offset += std::max(1, skip_until(input.head(), '/'));
-
-                        if (peek(input, -1) == '*')
-                        {
-                            ++input.offset;
-                            break;
-                        }
-                    }
+                    const char* end = scan::find_comment_end(input.head() + 1, input.end());
+                    advance_to(input, end != input.end() ? end + 1 : end);
                 }
                 // False positive: probably an operator, just return to process.
                 else
                 {
-                    return ch;
+                    return true;
                 }
+
+                stats.skipped_comment(input.offset - start);
             }
             // We skip past whitespace.
             else if (is_whitespace(ch))
             {
-                ++input.offset;
+                advance_to(input, scan::skip_whitespace(input.head(), input.end()));
+                stats.skipped_whitespace(input.offset - start);
             }
             // Anything else is valid to process.
             else
             {
-                return ch;
+                return true;
             }
         }
 
-        return '\0';
+        return false;
     }
 
-    std::vector<DebugRange> make_debug_ranges(const char* data)
+    // Parses the preprocessor line from input (at its '#') to end. Lines that don't parse are skipped like any other.
+    void record_directive(const LexerInput& input, const char* end, std::pmr::vector<Directive>& directives)
     {
-        const char* head = data;
-
-        int line = 0;
-        int line_idx_start = 0;
+        const char* base = input.base;
+        const char* head = input.head() + 1;
 
-        std::vector<DebugRange> ranges;
+        const auto skip_blanks = [&]()
+        {
+            while (head < end && (*head == ' ' || *head == '\t')) ++head;
+        };
 
-        while (const char ch = *head++)
+        const auto read_identifier = [&]()
         {
-            if (ch == '\n')
-            {
-                const int line_idx_next = (int)(head - data);
-                ranges.push_back({ line, line_idx_start, line_idx_next - 1 });
-                line = line + 1;
-                line_idx_start = line_idx_next;
-            }
-        }
+            const char* start = head;
+            while (head < end && is_identifier_char(*head)) ++head;
+            return NameBufferEntry { (int)(start - base), (int)(head - start) };
+        };
 
-        ranges.push_back({ line, line_idx_start, (int)(head - data - 1) });
-        return ranges;
-    }
+        skip_blanks();
+        const NameBufferEntry word = read_identifier();
+        const std::string_view keyword(base + word.idx, word.len);
+        skip_blanks();
 
-    const DebugRange& find_debug_range(const std::vector<DebugRange>& ranges, const LexerInput& input)
-    {
-        DebugRange target_range;
-        target_range.index_end = input.offset;
-        auto iter = std::lower_bound(std::begin(ranges), std::end(ranges), target_range,
-            [](const auto& lhs, const auto rhs) { return lhs.index_end < rhs.index_end; });
-        NWTREES_ASSERT(iter != std::end(ranges));
-        return *iter;
-    }
+        if (keyword == "include")
+        {
+            if (head == end || *head != '\"') return;
 
-    bool tokenize_keyword(const LexerInput& input, LexerMatch* match)
-    {
-        Keyword keyword;
+            const char* close = std::find(head + 1, end, '\"');
+            if (close == end) return;
 
-        switch (read(input))
+            directives.push_back({ Directive::Include, input.offset, { (int)(head + 1 - base), (int)(close - head - 1) }, { 0, 0 } });
+        }
+        else if (keyword == "define")
         {
-            case 'a': keyword = Keyword::Action; break;
-            case 'b': keyword = Keyword::Break; break;
-            case 'c': keyword = peek(input) == 'a' ? peek(input, 3) != 's' ? Keyword::Case : Keyword::Cassowary : Keyword::Const; break;
-            case 'd': keyword = peek(input) == 'e' ? Keyword::Default : Keyword::Do; break;
-            case 'e': switch (peek(input))
-            {
-                case 'f': keyword = Keyword::Effect; break;
-                case 'l': keyword = Keyword::Else; break;
-                case 'v': keyword = Keyword::Event; break;
-                default: return false;
-            }; break;
-            case 'f': keyword = peek(input) == 'l' ? Keyword::Float : Keyword::For; break;
-            case 'i': switch (peek(input))
-            {
-                case 'f': keyword = Keyword::If; break;
-                case 'n': keyword = Keyword::Int; break;
-                case 't': keyword = Keyword::ItemProperty; break;
-                default: return false;
-            }; break;
-            case 'l': keyword = Keyword::Location; break;
-            case 'o': keyword = Keyword::Object; break;
-            case 'r': keyword = Keyword::Return; break;
-            case 's': switch (peek(input))
+            const NameBufferEntry name = read_identifier();
+            if (name.len == 0) return;
+            skip_blanks();
+
+            // A "//" inside a string literal doesn't start a comment.
+            const char* value_end = head;
+            for (bool in_string = false; value_end < end; ++value_end)
             {
-                case 'q': keyword = Keyword::SqlQuery; break;
-                case 't': keyword = peek(input, 3) == 'i' ? Keyword::String : Keyword::Struct; break;
-                case 'w': keyword = Keyword::Switch; break;
-                default: return false;
-            }; break;
-            case 't': keyword = Keyword::Talent; break;
-            case 'v': keyword = peek(input) == 'e' ? Keyword::Vector : Keyword::Void; break;
-            case 'w': keyword = Keyword::While; break;
+                if (*value_end == '\"') in_string = !in_string;
+                else if (!in_string && *value_end == '/' && value_end + 1 < end && value_end[1] == '/') break;
+            }
+
+            while (value_end > head && is_whitespace(value_end[-1])) --value_end;
 
-            default: return false;
+            directives.push_back({ Directive::Define, input.offset, name, { (int)(head - base), (int)(value_end - head) } });
         }
+    }
 
-        const std::string_view& keyword_sv = keywords[(int)keyword].first;
+    bool find_keyword(const char* str, int len, Keyword* keyword)
+    {
+        if (len < keyword_table.min_len || len > keyword_table.max_len) return false;
 
-        if (std::strncmp(input.head(), keyword_sv.data(), keyword_sv.length()) == 0)
-        {
-            match->length = (int)keyword_sv.length();
-            match->token.type = Token::Keyword;
-            match->token.keyword = keyword;
-            return true;
-        }
+        const int slot = keyword_table.slots[keyword_hash(str, len, keyword_table.seed)];
+        if (slot == 0) return false;
 
-        return false;
+        const std::string_view& keyword_sv = keywords[slot - 1].first;
+        if (keyword_sv.length() != (size_t)len || std::memcmp(str, keyword_sv.data(), len) != 0) return false;
+
+        *keyword = (Keyword)(slot - 1);
+        return true;
     }
 
     bool tokenize_identifier(const LexerInput& input, LexerMatch* match)
     {
         const char* head = input.head();
-        if (!is_letter(*head) && *head != '_') return false;
+        while (++head < input.end() && is_identifier_char(*head));
+
+        match->length = (int)(head - input.head());
 
-        while (const char ch = *++head)
+        // The whole identifier has been scanned; it is only a keyword if it matches one exactly.
+        if (find_keyword(input.head(), match->length, &match->token.keyword))
         {
-            if (!is_letter(ch) && !is_digit(ch) && ch != '_') break;
+            match->token.type = Token::Keyword;
+        }
+        else
+        {
+            match->token.type = Token::Identifier;
+            match->token.identifier_data = { input.offset, match->length };
         }
 
-        match->length = (int)(head - input.head());
-        match->token.type = Token::Identifier;
-        match->token.identifier_data = { input.offset, match->length };
         return true;
     }
 
@@ -245,14 +582,13 @@ namespace
             LexerInput temp_input = input;
             ++temp_input.offset;
 
-            while (read(temp_input))
+            while (true)
             {
-                const char* head = temp_input.head();
-                temp_input.offset += skip_until(head, '\"', '\n');
+                advance_to(temp_input, scan::find_string_end(temp_input.head(), temp_input.end()));
 
-                if (read(temp_input) == '\n')
+                if (read(temp_input) != '\"')
                 {
-                    return false; // New line inside string (non-escaped); this string is invalid.
+                    return false; // New line (non-escaped) or end of input inside string; this string is invalid.
                 }
                 else if (peek(temp_input, -1) == '\\')
                 {
@@ -273,12 +609,17 @@ namespace
         else if (is_number || is_decimal || is_sign)
         {
             const bool is_hex = first_ch == '0' && (peek(input) == 'x' || peek(input) == 'X');
+            const int base = is_hex ? 16 : 10; // note: nwscript does not support octal with leading 0
 
             bool seen_number = is_number;
             bool seen_decimal = is_decimal;
             bool seen_exponent = false;
             bool seen_float_specifier = false;
 
+            // Ints are built up as the digits are scanned. Like strtol, they saturate at the limits of a long,
+            // and are then truncated to int; floats are parsed once their extent is known.
+            uint64_t magnitude = is_number && !is_hex ? (uint64_t)(first_ch - '0') : 0;
+
             // If we're a number, we need to keep track of whether we've seen a decimal place,
             // and scan until we're no longer a number or a decimal place.
             int distance;
@@ -291,6 +632,10 @@ namespace
                 else if (!is_hex && !seen_exponent && ch == 'e')
                 {
                     seen_exponent = true;
+
+                    // The exponent may carry its own sign.
+                    const char sign_ch = peek(input, distance + 1);
+                    if ((sign_ch == '+' || sign_ch == '-') && is_digit(peek(input, distance + 2))) ++distance;
                 }
                 else if (!is_hex && !seen_float_specifier && ch == 'f')
                 {
@@ -299,20 +644,13 @@ namespace
                 else if (is_digit(ch) || (is_hex && is_digit_hex(ch)))
                 {
                     seen_number = true;
+                    magnitude = accumulate_digit(magnitude, base, digit_value(ch));
                 }
                 else
                 {
-                    // We need to check whether this non-digit is a punctuator or whitespace.
-                    // If it is, we are a valid literal; if it isn't, this is an invalid token.
-                    LexerInput temp_input = input;
-                    temp_input.offset += distance;
-
-                    if (!tokenize_punctuator(temp_input, match) && // note: match is written over later so it doesn't matter
-                        !is_whitespace(read(temp_input)))
-                    {
-                        return false;
-                    }
-
+                    // If this non-digit is a punctuator or whitespace, we are a valid literal;
+                    // if it isn't, this is an invalid token.
+                    if (!is_number_terminator(ch)) return false;
                     break;
                 }
             }
@@ -321,36 +659,32 @@ namespace
 
             if (!seen_number) return false;
 
-            // Now we can proceed with parsing from the string representation.
-
             match->length = distance;
             match->token.type = Token::Literal;
 
-            const char* head = input.head();
-            char* parsed_head;
-
             // If we've seen a decimal, exponent, or floating specifier, we're a float.
             if (seen_decimal || seen_exponent || seen_float_specifier)
             {
-                const double parsed = std::strtod(input.head(), &parsed_head);
+                // from_chars rounds exactly as strtod does, but knows no locale, and takes no leading '+'.
+                const char* head = input.head() + (first_ch == '+');
+                double parsed = 0.0;
+
+                if (std::from_chars(head, input.head() + distance, parsed).ec == std::errc::result_out_of_range)
+                {
+                    // strtod gives infinity or zero here; from_chars leaves the value alone.
+                    parsed = is_overflow(head, input.head() + distance) ? HUGE_VAL : 0.0;
+                    if (first_ch == '-') parsed = -parsed;
+                }
                 match->token.literal = Literal::Float;
                 match->token.literal_data.flt = (float)parsed;
             }
             // Otherwise, we're an int.
             else
             {
-                const int base = is_hex ? 16 : 10; // note: nwscript does not support octal with leading 0
-                const long int parsed = std::strtol(input.head(), &parsed_head, base);
                 match->token.literal = Literal::Int;
-                match->token.literal_data.integer = (int)parsed;
+                match->token.literal_data.integer = (int)saturate(magnitude, first_ch == '-');
             }
 
-            int parsed_distance = (int)(parsed_head - head);
-            if (seen_float_specifier) ++parsed_distance; // parsing skipped the float specifier, account for it here
-
-            NWTREES_ASSERT_MSG(parsed_distance == distance,
-                "The function that parses numbers disagrees with how long the number is.");
-
             return true;
         }
 
@@ -359,173 +693,729 @@ namespace
 
     bool tokenize_punctuator(const LexerInput& input, LexerMatch* match)
     {
-        Punctuator punctuator;
+        int state = 0;
 
-        switch (read(input))
+        for (int i = 0; state < punctuator_dfa.node_count; ++i)
         {
-            case '&': switch (peek(input))
-            {
-                default: punctuator = Punctuator::Amp; break;
-                case '&': punctuator = Punctuator::AmpAmp; break;
-                case '=': punctuator = Punctuator::AmpEquals; break;
-            }; break;
-            case '*': punctuator = peek(input) != '=' ? Punctuator::Asterisk : Punctuator::AsteriskEquals; break;
-            case '^': punctuator = peek(input) != '=' ? Punctuator::Caret : Punctuator::CaretEquals; break;
-            case ':': punctuator = peek(input) != ':' ? Punctuator::Colon : Punctuator::ColonColon; break;
-            case ',': punctuator = Punctuator::Comma; break;
-            case '.': punctuator = peek(input) != '.' || peek(input, 2) != '.' ? Punctuator::Dot : Punctuator::DotDotDot; break;
-            case '=': punctuator = peek(input) != '=' ? Punctuator::Equal : Punctuator::EqualEqual; break;
-            case '!': punctuator = peek(input) != '=' ? Punctuator::Exclamation : Punctuator::ExclamationEquals; break;
-            case '>': switch (peek(input))
-            {
-                default: punctuator = Punctuator::Greater; break;
-                case '=': punctuator = Punctuator::GreaterEquals; break;
-                case '>': punctuator = peek(input, 2) != '=' ? Punctuator::GreaterGreater : Punctuator::GreaterGreaterEquals; break;
-            }; break;
-            case '{': punctuator = Punctuator::LeftCurlyBracket; break;
-            case '(': punctuator = Punctuator::LeftParen; break;
-            case '[': punctuator = Punctuator::LeftSquareBracket; break;
-            case '<': switch (peek(input))
-            {
-                default: punctuator = Punctuator::Less; break;
-                case '=': punctuator = Punctuator::LessEquals; break;
-                case '<': punctuator = peek(input, 2) != '=' ? Punctuator::LessLess : Punctuator::LessLessEquals; break;
-            }; break;
-            case '-': switch (peek(input))
-            {
-                default: punctuator = Punctuator::Minus; break;
-                case '=': punctuator = Punctuator::MinusEquals; break;
-                case '-': punctuator = Punctuator::MinusMinus; break;
-            }; break;
-            case '%': punctuator = peek(input) != '=' ? Punctuator::Modulo : Punctuator::ModuloEquals; break;
-            case '|': switch (peek(input))
-            {
-                default: punctuator = Punctuator::Pipe; break;
-                case '=': punctuator = Punctuator::PipeEquals; break;
-                case '|': punctuator = Punctuator::PipePipe; break;
-            }; break;
-            case '+': switch (peek(input))
-            {
-                default: punctuator = Punctuator::Plus; break;
-                case '=': punctuator = Punctuator::PlusEquals; break;
-                case '+': punctuator = Punctuator::PlusPlus; break;
-            }; break;
-            case '?': punctuator = Punctuator::Question; break;
-            case '}': punctuator = Punctuator::RightCurlyBracket; break;
-            case ')': punctuator = Punctuator::RightParen; break;
-            case ']': punctuator = Punctuator::RightSquareBracket; break;
-            case ';': punctuator = Punctuator::Semicolon; break;
-            case '/': punctuator = peek(input) != '=' ? Punctuator::Slash : Punctuator::SlashEquals; break;
-            case '~': punctuator = Punctuator::Tilde; break;
-
-            default: return false;
-        }
-
-        match->length = (int)punctuators[(int)punctuator].first.length();
+            state = punctuator_dfa.next[state][punctuator_dfa.classes[(uint8_t)peek(input, i)]];
+        }
+
+        const int longest = punctuator_dfa.longest[state];
+        if (longest == 0) return false;
+
+        const Punctuator punctuator = (Punctuator)(longest - 1);
+
+        match->length = punctuator_dfa.longest_len[state];
         match->token.type = Token::Punctuator;
         match->token.punctuator = punctuator;
 
         return true;
     }
-}
 
-LexerOutput nwtrees::lexer(const char* data, LexerOutput&& prev_output)
-{
-    LexerOutput output = std::move(prev_output);
-    prepare_output(output);
+    // Absorbs any string literals that immediately follow the one in token into it.
+    // A literal that fails to lex is left for the next call to report.
+    template <typename Config, typename Stats>
+    void merge_string_literals(LexerInput& input, LexerOutput& output, const LexerOptions& options,
+        SymbolTable& symbols, Token* token, Stats& stats)
+    {
+        NameBufferEntry& str = token->literal_data.str;
+        LexerMatch match;
+
+        // Entries from here up index the name buffer.
+        const int names_base = names_in_source<Config>(options) ? input.length : 0;
+
+        while (seek(input, records_directives<Config>(options) ? &output.directives : nullptr, stats) && read(input) == '\"' && tokenize_literal(input, &match))
+        {
+            stats.merged_string();
+
+            // A string still in the source is copied out the first time something is merged into it.
+            if (str.idx < names_base)
+            {
+                const size_t new_idx = output.names.size();
+                output.names.resize(new_idx + str.len);
+                std::memcpy(output.names.data() + new_idx, input.base + str.idx, str.len);
+                str.idx = names_base + (int)new_idx;
+            }
 
-    LexerInput input = { data, 0 };
+            const NameBufferEntry& next_str = match.token.literal_data.str;
+            const size_t str_end = str.idx - names_base + str.len;
+            output.names.resize(str_end + next_str.len);
+            std::memcpy(output.names.data() + str_end, input.base + next_str.idx, next_str.len);
+            str.len += next_str.len;
+            input.offset += match.length;
+        }
 
-    while (seek(input))
+        // Interned strings only needed the name buffer until they were complete.
+        if (interns<Config>(options))
+        {
+            const NameBufferEntry entry = str;
+            token->symbol = symbols.intern(std::string_view(output.names.data() + entry.idx, entry.len));
+            output.names.resize(entry.idx);
+        }
+    }
+
+    // Adds an error for the text at input that no tokenizer accepts, and returns how much of it to skip to recover.
+    int record_error(const LexerInput& input, LexerOutput& output)
     {
-        LexerMatch matches[Token::EnumCount];
-        int match_count = 0;
+        const char ch = read(input);
+        LexerInput end = input;
 
-        // -- Gather all matches.
+        Error::Code code;
+        int message = -1;
 
-        if (tokenize_keyword(input, matches + match_count))
+        if (ch == '\"')
+        {
+            // The string runs to the end of the line either way.
+            code = Error::UnterminatedString;
+            advance_to(end, scan::find_newline(input.head(), input.end()));
+        }
+        else if (classify(ch) == CharClass::Digit || classify(ch) == CharClass::Sign || classify(ch) == CharClass::Dot)
         {
-            ++match_count;
+            // Some prefix looked like a number, but the whole of it doesn't; skip everything that could be part of it.
+            code = Error::InvalidNumber;
+            while (end.offset < end.length && (is_identifier_char(read(end)) || read(end) == '.')) ++end.offset;
         }
+        else
+        {
+            // One error for a run of bad bytes, so a multi-byte character from another encoding is reported once.
+            code = Error::InvalidCharacter;
+            while (end.offset < end.length && classify(read(end)) == CharClass::Invalid) ++end.offset;
+
+            char buff[64];
+            if (ch > ' ' && ch < 127) snprintf(buff, sizeof(buff), "unexpected character '%c'", ch);
+            else snprintf(buff, sizeof(buff), "unexpected byte 0x%02X", (unsigned)(uint8_t)ch);
+            message = output.diagnostics.intern(buff);
+        }
+
+        output.errors.emplace_back(code, input.offset, message);
+        return std::max(end.offset - input.offset, 1);
+    }
 
-        if (tokenize_identifier(input, matches + match_count))
+    // Lexes the token at (or after skipping whatever precedes) input.offset, stepping input past it.
+    // This is the whole of both LexerStream::next and the batch lexer's loop.
+    template <typename Config, typename Stats>
+    LexResult lex_token(LexerInput& input, LexerOutput& output, const LexerOptions& options,
+        SymbolTable& symbols, Token* token, int* offset, Stats& stats)
+    {
+        LexerMatch match;
+        uint64_t start = stats.now();
+
+        while (true)
         {
-            ++match_count;
+            const bool found = seek(input, records_directives<Config>(options) ? &output.directives : nullptr, stats);
+            start = stats.seek_done(start);
+            if (!found) return LexResult::End;
+
+            bool matched;
+
+            // -- Dispatch to the only tokenizer that can start with this character.
+            // Note: a number is always longer than the punctuator that shares its first character, so we try it first.
+
+            switch (classify(read(input)))
+            {
+                case CharClass::Letter: matched = tokenize_identifier(input, &match); break;
+                case CharClass::Digit:
+                case CharClass::Quote: matched = tokenize_literal(input, &match); break;
+                case CharClass::Sign:
+                case CharClass::Dot: matched = tokenize_literal(input, &match) || tokenize_punctuator(input, &match); break;
+                case CharClass::Punctuator: matched = tokenize_punctuator(input, &match); break;
+                default: matched = false; break;
+            }
+
+            if (matched) break;
+
+            const int skip = record_error(input, output);
+            if (!recovers<Config>(options) || (options.max_errors > 0 && (int)output.errors.size() >= options.max_errors)) return LexResult::Error;
+            input.offset += skip;
         }
 
-        if (tokenize_literal(input, matches + match_count))
+        *offset = input.offset;
+        input.offset += match.length;
+
+        *token = match.token;
+
+        // -- For tokens that need name buffers, prepare the buffer and update the name entry.
+
+        const bool is_identifier = token->type == Token::Identifier;
+        const bool is_str_literal = token->type == Token::Literal && token->literal == Literal::String;
+
+        if (is_identifier && interns<Config>(options))
+        {
+            const NameBufferEntry& entry = token->identifier_data;
+            token->symbol = symbols.intern(std::string_view(input.base + entry.idx, entry.len));
+        }
+        else if ((is_identifier || is_str_literal) && !names_in_source<Config>(options))
         {
-            ++match_count;
+            NameBufferEntry* entry = is_identifier ? &token->identifier_data : &token->literal_data.str;
+            const size_t new_idx = output.names.size();
+            output.names.resize(new_idx + entry->len);
+            std::memcpy(output.names.data() + new_idx, input.base + entry->idx, entry->len);
+            entry->idx = (int)new_idx;
         }
 
-        if (tokenize_punctuator(input, matches + match_count))
+        // -- If we're a string literal, we merge the string literals that follow into ourself.
+
+        if (is_str_literal)
         {
-            ++match_count;
+            merge_string_literals<Config>(input, output, options, symbols, token, stats);
         }
 
-        if (!match_count)
+        stats.lexed(*token);
+        stats.tokenize_done(start);
+
+        return LexResult::Token;
+    }
+
+    // The entry for the token's text in LexerOutput::names, if it has one.
+    NameBufferEntry* name_entry(Token& token, const LexerOptions& options)
+    {
+        if (options.intern_names) return nullptr;
+        if (token.type == Token::Identifier) return &token.identifier_data;
+        if (token.type == Token::Literal && token.literal == Literal::String) return &token.literal_data.str;
+        return nullptr;
+    }
+
+    // Appends the tokens of data to output.
+    template <typename Config, typename Stats>
+    void lex_all(const std::string_view data, LexerOutput& output, const LexerOptions& options, Stats& stats)
+    {
+        SymbolTable& symbols = options.symbols ? *options.symbols : output.symbols;
+
+        LexerInput input = { data.data(), 0, (int)data.size() };
+
+        if (uses_arrays<Config>(options))
         {
-            const DebugRange& range = find_debug_range(make_debug_ranges(data), input);
+            Token token;
+            int offset;
 
-            char line_buff[128];
-            const size_t len_to_copy = std::min(sizeof(line_buff) - 1, (size_t)(range.index_end - range.index_start));
-            memcpy(line_buff, data + range.index_start, len_to_copy);
-            line_buff[len_to_copy] = '\0';
-            output.errors.emplace_back(Error::Unknown, std::vector<std::string>{"Unknown Token", line_buff});
-            break;
-        }
+            while (lex_token<Config>(input, output, options, symbols, &token, &offset, stats) == LexResult::Token)
+            {
+                output.kinds.push_back(token_kind::of(token));
+                output.payloads.push_back(payload_of(token));
+                output.offsets.push_back(offset);
+            }
 
-        // -- Sort by token length: longest length wins.
-        // Note: the stable_sort ensures that if we need to choose between an equal-length token of different types,
-        //       we select the token in the same order as listed above. This is important for keyword vs identifier.
+            return;
+        }
 
-        if (match_count > 1)
+        // Tokens are lexed straight into place; the slot left over at the end is dropped.
+        while (true)
         {
-            std::stable_sort(matches, matches + match_count, &cmp);
+            Token& token = output.tokens.emplace_back();
+            int& offset = output.offsets.emplace_back();
+            if (lex_token<Config>(input, output, options, symbols, &token, &offset, stats) != LexResult::Token)
+            {
+                output.tokens.pop_back();
+                output.offsets.pop_back();
+                break;
+            }
         }
+    }
 
-        LexerMatch& selected_match = matches[0];
-        bool should_commit_match = true;
+    void lex_chunk(const std::string_view data, const LexerOptions& options, LexerChunk* chunk)
+    {
+        LexerOutput& output = chunk->into ? *chunk->into : chunk->output;
+        if (names_in_source(options)) output.source = data;
 
-        // -- For tokens that need name buffers, prepare the buffer and update the name entry.
+        // As for a batch: a little over what real scripts average.
+        const size_t bytes = chunk->end - chunk->begin;
+        output.tokens.reserve(bytes / 5 + 1);
+        output.offsets.reserve(bytes / 5 + 1);
+        if (!names_in_source(options)) output.names.reserve(bytes / 3 + 1);
+
+        LexerInput input = { data.data(), chunk->begin, (int)data.size() };
+        NoStats stats;
+
+        while (true)
+        {
+            const int start = input.offset;
+            const size_t names = output.names.size();
+            const size_t errors = output.errors.size();
+            const size_t directives = output.directives.size();
+
+            Token token;
+            int offset;
+            const LexResult result = lex_token<LexerConfig>(input, output, options, output.symbols, &token, &offset, stats);
+
+            // Whatever was found past the end is the next chunk's, so it's taken back, and lexing stops before it.
+            const int found_at = result == LexResult::Token ? offset : result == LexResult::Error ? output.errors.back().offset : -1;
 
-        Token& token = selected_match.token;
+            if (found_at >= chunk->end)
+            {
+                output.names.resize(names);
+                output.errors.erase(output.errors.begin() + errors, output.errors.end());
+                output.directives.resize(directives);
+                chunk->resume = start;
+                chunk->result = LexResult::Token;
+                return;
+            }
 
+            if (result != LexResult::Token)
+            {
+                chunk->resume = input.offset;
+                chunk->result = result;
+                return;
+            }
+
+            output.tokens.push_back(token);
+            output.offsets.push_back(offset);
+        }
+    }
+
+    // Copies a token lexed without interning into output as options would have lexed it.
+    void adopt_token(Token token, const int offset, const LexerOutput& from, LexerOutput& output, const LexerOptions& options, SymbolTable& symbols)
+    {
         const bool is_identifier = token.type == Token::Identifier;
         const bool is_str_literal = token.type == Token::Literal && token.literal == Literal::String;
 
         if (is_identifier || is_str_literal)
         {
-            NameBufferEntry* entry = is_identifier ? &token.identifier_data : &token.literal_data.str;
-            const size_t new_idx = output.names.size();
-            output.names.resize(new_idx + entry->len);
-            std::memcpy(output.names.data() + new_idx, input.base + entry->idx, entry->len);
-            entry->idx = (int)new_idx;
+            NameBufferEntry& entry = is_identifier ? token.identifier_data : token.literal_data.str;
+            const std::string_view text = from.text(entry);
+
+            if (options.intern_names)
+            {
+                token.symbol = symbols.intern(text);
+            }
+            else if (!names_in_source(options) || entry.idx >= (int)from.source.size())
+            {
+                const size_t new_idx = output.names.size();
+                output.names.insert(output.names.end(), text.begin(), text.end());
+                entry.idx = (int)(output.source.size() + new_idx);
+            }
         }
 
-        // -- If we're a string literal, we merge ourself with the previous token if it was also a string literal.
+        if (options.layout == TokenLayout::Arrays)
+        {
+            output.kinds.push_back(token_kind::of(token));
+            output.payloads.push_back(payload_of(token));
+        }
+        else
+        {
+            output.tokens.push_back(token);
+        }
+
+        output.offsets.push_back(offset);
+    }
+
+    // Copies the tokens of from (a chunk's output, lexed without interning) from first on into output, as options would have lexed them.
+    void adopt_chunk(const LexerOutput& from, const size_t first, LexerOutput& output, const LexerOptions& options, SymbolTable& symbols)
+    {
+        // Interning has to look at each name anyway.
+        if (options.intern_names)
+        {
+            for (size_t i = first; i < from.tokens.size(); ++i) adopt_token(from.tokens[i], from.offsets[i], from, output, options, symbols);
+            return;
+        }
+
+        // Otherwise both outputs keep names the same way, and the names from first on are one range at the end of from's.
+        const int names_base = (int)from.source.size();
+        size_t names_cut = from.names.size();
 
-        if (is_str_literal && !output.tokens.empty())
+        for (size_t i = first; i < from.tokens.size(); ++i)
         {
-            Token& last_token = output.tokens[output.tokens.size() - 1];
-            if (last_token.type == Token::Literal && last_token.literal == Literal::String)
+            Token token = from.tokens[i];
+            const NameBufferEntry* entry = name_entry(token, options);
+            if (entry && entry->idx >= names_base) { names_cut = entry->idx - names_base; break; }
+        }
+
+        const int names_delta = (int)output.names.size() - (int)names_cut;
+        output.names.insert(output.names.end(), from.names.begin() + names_cut, from.names.end());
+        output.offsets.insert(output.offsets.end(), from.offsets.begin() + first, from.offsets.end());
+
+        if (options.layout == TokenLayout::Structs)
+        {
+            const size_t at = output.tokens.size();
+            output.tokens.insert(output.tokens.end(), from.tokens.begin() + first, from.tokens.end());
+
+            for (size_t i = at; names_delta != 0 && i < output.tokens.size(); ++i)
             {
-                last_token.literal_data.str.len += token.literal_data.str.len;
-                should_commit_match = false;
+                NameBufferEntry* entry = name_entry(output.tokens[i], options);
+                if (entry && entry->idx >= names_base) entry->idx += names_delta;
             }
+
+            return;
         }
 
-        // -- Commit token.
+        for (size_t i = first; i < from.tokens.size(); ++i)
+        {
+            Token token = from.tokens[i];
+            NameBufferEntry* entry = name_entry(token, options);
+            if (entry && entry->idx >= names_base) entry->idx += names_delta;
+
+            output.kinds.push_back(token_kind::of(token));
+            output.payloads.push_back(payload_of(token));
+        }
+    }
 
-        if (should_commit_match)
+    // Appends the tokens of data to output, exactly as lex_all would, from count chunks lexed at once.
+    // From the start of the source, a stitching pass lexes token by token until it finds a token that a chunk also found;
+    // since lexing from a token depends on nothing before it, the rest of that chunk is then taken as it is.
+    // Chunks start at line starts, so this is almost always their first token, unless a comment or string runs across the line.
+    void lex_chunks(const std::string_view data, LexerOutput& output, const LexerOptions& options, const int count)
+    {
+        // Chunks intern nothing, as their tables would number symbols differently from one pass; names that will be interned
+        // are left in the source until then.
+        LexerOptions chunk_options = options;
+        chunk_options.intern_names = false;
+        chunk_options.source_names = options.source_names || options.intern_names;
+        chunk_options.symbols = nullptr;
+        chunk_options.layout = TokenLayout::Structs;
+
+        std::vector<LexerChunk> chunks(count);
+
+        const char* end = data.data() + data.size();
+
+        for (int i = 0; i < count; ++i)
         {
-            output.tokens.push_back(token);
+            LexerChunk& chunk = chunks[i];
+            const size_t guess = data.size() / count * i;
+            chunk.begin = i == 0 ? 0 : std::max(chunks[i - 1].begin, (int)(scan::find_newline(data.data() + guess, end) - data.data()));
+            if (i > 0) chunks[i - 1].end = chunk.begin;
+        }
+
+        chunks.back().end = (int)data.size();
+
+        // The first chunk starts at a token boundary, so unless its tokens need converting, it can lex straight into the output.
+        const bool first_in_place = !options.intern_names && options.layout == TokenLayout::Structs;
+
+        if (first_in_place)
+        {
+            output.tokens.reserve(data.size() / 5 + 1);
+            output.offsets.reserve(data.size() / 5 + 1);
+            if (!names_in_source(options)) output.names.reserve(data.size() / 3 + 1);
+            chunks[0].into = &output;
+        }
+
+        {
+            std::vector<std::thread> threads;
+            threads.reserve(count - 1);
+            for (int i = 1; i < count; ++i) threads.emplace_back(lex_chunk, data, std::cref(chunk_options), &chunks[i]);
+            lex_chunk(data, chunk_options, &chunks[0]);
+            for (std::thread& thread : threads) thread.join();
         }
 
-        // -- Step stream forward, past the matched token length.
+        if (first_in_place && chunks[0].result != LexResult::Token) return;
 
-        input.offset += selected_match.length;
+        SymbolTable& symbols = options.symbols ? *options.symbols : output.symbols;
+
+        // Adds from's errors and directives that were found from first_offset to last_offset, inclusive.
+        const auto adopt_rest = [&](const LexerOutput& from, const int first_offset, const int last_offset)
+        {
+            for (const Error& error : from.errors)
+            {
+                if (error.offset < first_offset || error.offset > last_offset) continue;
+                const std::string_view message = from.message(error);
+                output.errors.emplace_back(error.code, error.offset, message.empty() ? -1 : output.diagnostics.intern(message));
+            }
+
+            for (const Directive& directive : from.directives)
+            {
+                if (directive.offset >= first_offset && directive.offset <= last_offset) output.directives.push_back(directive);
+            }
+        };
+
+        LexerOutput scratch(output.resource());
+        if (names_in_source(chunk_options)) scratch.source = data;
+
+        LexerInput input = { data.data(), first_in_place ? chunks[0].resume : 0, (int)data.size() };
+        size_t next = first_in_place ? 1 : 0;
+        NoStats stats;
+
+        while (true)
+        {
+            scratch.names.clear();
+            scratch.errors.clear();
+            scratch.directives.clear();
+
+            Token token;
+            int offset;
+            const LexResult result = lex_token<LexerConfig>(input, scratch, chunk_options, scratch.symbols, &token, &offset, stats);
+
+            if (result != LexResult::Token)
+            {
+                adopt_rest(scratch, 0, INT_MAX);
+                return;
+            }
+
+            while (next + 1 < chunks.size() && chunks[next + 1].begin <= offset) ++next;
+
+            const LexerChunk& chunk = chunks[next];
+            const std::pmr::vector<int>& offsets = chunk.output.offsets;
+            const auto synced = std::lower_bound(offsets.begin(), offsets.end(), offset);
+
+            if (synced == offsets.end() || *synced != offset)
+            {
+                adopt_rest(scratch, 0, INT_MAX);
+                adopt_token(token, offset, scratch, output, options, symbols);
+                continue;
+            }
+
+            // What was found on the way to the token is the stitching pass's; from the token on (including any directives
+            // skipped while looking for strings to merge into it) it's the chunk's.
+            adopt_rest(scratch, 0, offset - 1);
+
+            adopt_chunk(chunk.output, synced - offsets.begin(), output, options, symbols);
+
+            adopt_rest(chunk.output, offset, INT_MAX);
+
+            // A chunk that reached the end of the source, or stopped at an error, ends the output just as lexing in one pass would.
+            if (chunk.result != LexResult::Token) return;
+
+            input.offset = chunk.resume;
+            ++next;
+        }
+    }
+}
+
+int nwtrees::chunk_count(const size_t size, const LexerOptions& options)
+{
+    // Each chunk would only know of its own errors, and stop at its own limit.
+    if (options.max_errors > 0) return 1;
+    return std::clamp<int>((int)std::min<size_t>(size / std::max(options.chunk_min_bytes, 1), INT_MAX), 1, std::max(options.threads, 1));
+}
+
+LexerOutput nwtrees::lexer(const char* data, LexerOutput&& prev_output, const LexerOptions& options)
+{
+    return lexer(std::string_view(data), std::move(prev_output), options);
+}
+
+LexerOutput nwtrees::lexer(const std::string_view data, LexerOutput&& prev_output, const LexerOptions& options)
+{
+    return lexer<LexerConfig>(data, std::move(prev_output), options);
+}
+
+template <typename Config>
+LexerOutput nwtrees::lexer(const std::string_view data, LexerOutput&& prev_output, const LexerOptions& options)
+{
+    const LexerOptions config_options = configured<Config>(options);
+
+    LexerOutput output = std::move(prev_output);
+    prepare_output(output);
+
+    if (names_in_source<Config>(config_options)) output.source = data;
+
+    const int chunks = chunk_count(data.size(), config_options);
+
+    // Chunks are lexed with every feature compiled in, but only asked for what the config allows.
+    if (chunks > 1)
+    {
+        lex_chunks(data, output, config_options, chunks);
+        return output;
+    }
+
+    NoStats stats;
+    lex_all<Config>(data, output, config_options, stats);
+    return output;
+}
+
+template LexerOutput nwtrees::lexer<LexerConfig>(std::string_view, LexerOutput&&, const LexerOptions&);
+template LexerOutput nwtrees::lexer<CompileLexerConfig>(std::string_view, LexerOutput&&, const LexerOptions&);
+template LexerOutput nwtrees::lexer<DiagnosticsLexerConfig>(std::string_view, LexerOutput&&, const LexerOptions&);
+
+LexerOutput nwtrees::lexer(const std::string_view data, LexerOutput&& prev_output, const LexerOptions& options, LexerStats& stats)
+{
+    LexerOutput output = std::move(prev_output);
+    prepare_output(output);
+
+    if (names_in_source(options)) output.source = data;
+
+    CountStats counts = { stats };
+    lex_all<LexerConfig>(data, output, options, counts);
+
+    ++stats.inputs;
+    stats.bytes += data.size();
+    stats.names_high_water = std::max<uint64_t>(stats.names_high_water, output.names.size());
+    stats.tokens_high_water = std::max<uint64_t>(stats.tokens_high_water, output.offsets.size());
+
+    return output;
+}
+
+LexerBatch nwtrees::lex_batch(const std::span<const std::string_view> sources, LexerBatch&& prev_batch, const LexerOptions& options)
+{
+    LexerBatch batch = std::move(prev_batch);
+    LexerOutput& output = batch.output;
+    prepare_output(output);
+    batch.files.clear();
+
+    // Roughly what real scripts average, a little over: a token for every five bytes, and a byte of names for every three.
+    size_t total_bytes = 0;
+    for (const std::string_view source : sources) total_bytes += source.size();
+
+    const size_t token_estimate = total_bytes / 5 + 1;
+
+    if (options.layout == TokenLayout::Arrays)
+    {
+        output.kinds.reserve(token_estimate);
+        output.payloads.reserve(token_estimate);
+    }
+    else
+    {
+        output.tokens.reserve(token_estimate);
+    }
+
+    output.offsets.reserve(token_estimate);
+    if (!options.intern_names) output.names.reserve(total_bytes / 3 + 1);
+    batch.files.reserve(sources.size());
+
+    NoStats stats;
+
+    for (const std::string_view source : sources)
+    {
+        LexerBatchFile& file = batch.files.emplace_back();
+        file.token_begin = (int)output.offsets.size();
+        file.names_begin = (int)output.names.size();
+        file.error_begin = (int)output.errors.size();
+        file.directive_begin = (int)output.directives.size();
+
+        lex_all<LexerConfig>(source, output, options, stats);
+
+        file.token_end = (int)output.offsets.size();
+        file.names_end = (int)output.names.size();
+        file.error_end = (int)output.errors.size();
+        file.directive_end = (int)output.directives.size();
+    }
+
+    return batch;
+}
+
+void LexerStats::add(const LexerStats& other)
+{
+    inputs += other.inputs;
+    bytes += other.bytes;
+    whitespace_bytes += other.whitespace_bytes;
+    comment_bytes += other.comment_bytes;
+    preprocessor_bytes += other.preprocessor_bytes;
+
+    for (size_t i = 0; i < tokens_by_type.size(); ++i) tokens_by_type[i] += other.tokens_by_type[i];
+    for (size_t i = 0; i < tokens_by_kind.size(); ++i) tokens_by_kind[i] += other.tokens_by_kind[i];
+
+    strings_merged += other.strings_merged;
+    names_high_water = std::max(names_high_water, other.names_high_water);
+    tokens_high_water = std::max(tokens_high_water, other.tokens_high_water);
+    seek_cycles += other.seek_cycles;
+    tokenize_cycles += other.tokenize_cycles;
+}
+
+LexerStream::LexerStream(const std::string_view data, LexerOutput& output, const LexerOptions& options)
+    : m_data(data),
+      m_output(output),
+      m_options(options),
+      m_symbols(options.symbols ? *options.symbols : output.symbols)
+{
+    if (names_in_source(options)) m_output.source = data;
+}
+
+bool LexerStream::next(Token* token)
+{
+    if (m_failed) return false;
+
+    LexerInput input = { m_data.data(), m_position, (int)m_data.size() };
+    NoStats stats;
+    const LexResult result = lex_token<LexerConfig>(input, m_output, m_options, m_symbols, token, &m_offset, stats);
+    m_position = input.offset;
+    m_failed = result == LexResult::Error;
+    return result == LexResult::Token;
+}
+
+LexerOutput nwtrees::relex(std::string& source, const LexerEdit& edit, LexerOutput&& prev_output, const LexerOptions& options)
+{
+    NWTREES_ASSERT(edit.offset >= 0 && edit.length >= 0 && edit.offset + edit.length <= (int)source.size());
+    source.replace(edit.offset, edit.length, edit.text);
+
+    // The previous lex stopped at its first error, so there is nothing past it to reuse.
+    // Output in the array layout, with directives, or with names in the source (which the edit has moved) isn't spliced;
+    // it is small enough to make from scratch. Nor is output with an error limit, which the spliced part couldn't know it had reached.
+    if (!prev_output.errors.empty() || options.layout == TokenLayout::Arrays || options.directives || names_in_source(options) || options.max_errors > 0)
+    {
+        return lexer(source, std::move(prev_output), options);
+    }
+
+    LexerOutput output = std::move(prev_output);
+    std::pmr::vector<Token>& tokens = output.tokens;
+    std::pmr::vector<int>& offsets = output.offsets;
+
+    // A token's extent depends on at most two characters past its end: "." looks two ahead for "...", and "1e" for the
+    // digit after an exponent's sign. A token is only unaffected by the edit, then, if the next one starts at least two
+    // characters before it; lexing restarts from the first token that isn't, which is the one before the first that
+    // starts any later.
+    const size_t first_after = std::lower_bound(offsets.begin(), offsets.end(), edit.offset) - offsets.begin();
+    const size_t first_near = std::lower_bound(offsets.begin(), offsets.begin() + first_after, edit.offset - 1) - offsets.begin();
+    const size_t restart = first_near > 0 ? first_near - 1 : 0;
+
+    const int delta = (int)edit.text.size() - edit.length;
+    const int new_edit_end = edit.offset + (int)edit.text.size();
+
+    LexerOutput fresh(output.resource());
+    SymbolTable& symbols = options.symbols ? *options.symbols : output.symbols;
+    NoStats stats;
+
+    LexerInput input = { source.data(), first_near > 0 ? offsets[restart] : 0, (int)source.size() };
+    size_t sync = tokens.size();
+
+    while (true)
+    {
+        const size_t names_len = fresh.names.size();
+
+        Token token;
+        int offset;
+
+        if (lex_token<LexerConfig>(input, fresh, options, symbols, &token, &offset, stats) != LexResult::Token) break;
+
+        // Past the edit both sources hold the same text, and lexing from a token boundary depends only on what follows it,
+        // so a token that starts where an old one did means the old tokens from there on are still correct.
+        if (offset >= new_edit_end)
+        {
+            const auto old = std::lower_bound(offsets.begin() + first_after, offsets.end(), offset - delta);
+            if (old != offsets.end() && *old == offset - delta)
+            {
+                sync = old - offsets.begin();
+                fresh.names.resize(names_len);
+                break;
+            }
+        }
+
+        fresh.tokens.push_back(token);
+        fresh.offsets.push_back(offset);
+    }
+
+    // -- Splice the re-lexed tokens in place of the old ones. Names are stored in token order, so theirs are a single range too.
+
+    const auto names_start = [&](size_t idx)
+    {
+        for (; idx < tokens.size(); ++idx)
+        {
+            if (const NameBufferEntry* entry = name_entry(tokens[idx], options)) return (size_t)entry->idx;
+        }
+
+        return output.names.size();
+    };
+
+    const size_t names_cut = names_start(restart);
+    const size_t names_kept = names_start(sync);
+    const int names_delta = (int)names_cut + (int)fresh.names.size() - (int)names_kept;
+
+    output.names.erase(output.names.begin() + names_cut, output.names.begin() + names_kept);
+    output.names.insert(output.names.begin() + names_cut, fresh.names.begin(), fresh.names.end());
+
+    tokens.erase(tokens.begin() + restart, tokens.begin() + sync);
+    tokens.insert(tokens.begin() + restart, fresh.tokens.begin(), fresh.tokens.end());
+    offsets.erase(offsets.begin() + restart, offsets.begin() + sync);
+    offsets.insert(offsets.begin() + restart, fresh.offsets.begin(), fresh.offsets.end());
+
+    const size_t tail = restart + fresh.tokens.size();
+
+    for (size_t i = restart; i < tail; ++i)
+    {
+        if (NameBufferEntry* entry = name_entry(tokens[i], options)) entry->idx += (int)names_cut;
+    }
+
+    for (size_t i = tail; i < tokens.size(); ++i)
+    {
+        if (NameBufferEntry* entry = name_entry(tokens[i], options)) entry->idx += names_delta;
+        offsets[i] += delta;
     }
 
+    output.errors = std::move(fresh.errors);
     return output;
 }
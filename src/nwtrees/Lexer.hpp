@@ -1,15 +1,25 @@
 #pragma once
 
+#include <nwtrees/SymbolTable.hpp>
 #include <nwtrees/util/Error.hpp>
 
 #include <array>
 #include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace nwtrees
 {
+    // Bump whenever the same source would lex to different tokens, or Token's layout changes; anything that
+    // keeps lexer output around (such as the compiler's token cache) uses it to throw away stale results.
+    static constexpr uint32_t lexer_version = 3;
+
     enum class Keyword : uint8_t
     {
         Action,
@@ -135,20 +145,358 @@ namespace nwtrees
                 int integer;
                 float flt;
             } literal_data;
+
+            // Identifiers and string literals, when lexed with LexerOptions::intern_names.
+            int symbol;
         };
     };
 
+    // A token's type and its keyword, literal or punctuator, folded into one byte for TokenLayout::Arrays.
+    // Identifiers are 0, then come the keywords, the literals and the punctuators, each in enum order.
+    using TokenKind = uint8_t;
+
+    namespace token_kind
+    {
+        static constexpr TokenKind identifier = 0;
+        static constexpr TokenKind first_keyword = 1;
+        static constexpr TokenKind first_literal = first_keyword + (TokenKind)Keyword::EnumCount;
+        static constexpr TokenKind first_punctuator = first_literal + 3;
+        static constexpr TokenKind count = first_punctuator + (TokenKind)Punctuator::EnumCount;
+
+        constexpr TokenKind of(const Keyword keyword) { return first_keyword + (TokenKind)keyword; }
+        constexpr TokenKind of(const Literal literal) { return first_literal + (TokenKind)literal; }
+        constexpr TokenKind of(const Punctuator punctuator) { return first_punctuator + (TokenKind)punctuator; }
+
+        constexpr TokenKind of(const Token& token)
+        {
+            switch (token.type)
+            {
+                case Token::Keyword: return of(token.keyword);
+                case Token::Literal: return of(token.literal);
+                case Token::Punctuator: return of(token.punctuator);
+                default: return identifier;
+            }
+        }
+
+        constexpr Token::Type type(const TokenKind kind)
+        {
+            if (kind >= first_punctuator) return Token::Punctuator;
+            if (kind >= first_literal) return Token::Literal;
+            if (kind >= first_keyword) return Token::Keyword;
+            return Token::Identifier;
+        }
+    }
+
+    // Everything in a Token after its kind, with the same members; TokenLayout::Arrays stores these apart from the kinds.
+    union TokenPayload
+    {
+        NameBufferEntry identifier_data;
+        decltype(Token::literal_data) literal_data;
+        int symbol;
+    };
+
+    static_assert(sizeof(TokenPayload) == sizeof(Token) - offsetof(Token, identifier_data));
+
+    inline TokenPayload payload_of(const Token& token)
+    {
+        TokenPayload payload;
+        std::memcpy(&payload, &token.identifier_data, sizeof(payload));
+        return payload;
+    }
+
+    inline Token make_token(const TokenKind kind, const TokenPayload& payload)
+    {
+        Token token;
+        token.type = token_kind::type(kind);
+
+        switch (token.type)
+        {
+            case Token::Keyword: token.keyword = (Keyword)(kind - token_kind::first_keyword); break;
+            case Token::Literal: token.literal = (Literal)(kind - token_kind::first_literal); break;
+            case Token::Punctuator: token.punctuator = (Punctuator)(kind - token_kind::first_punctuator); break;
+            default: token.keyword = (Keyword)0; break;
+        }
+
+        std::memcpy(&token.identifier_data, &payload, sizeof(payload));
+        return token;
+    }
+
+    enum class TokenLayout
+    {
+        // LexerOutput::tokens holds whole tokens.
+        Structs,
+
+        // LexerOutput::kinds and LexerOutput::payloads hold the tokens' two halves, and tokens is left empty.
+        // Passes that only look at what each token is (matching brackets, finding declarations) then read one byte per token.
+        Arrays,
+    };
+
+    // A preprocessor line the lexer recorded rather than skipped, with LexerOptions::directives.
+    // Unlike a token's, its ranges point into the source itself, not into LexerOutput::names.
+    struct Directive
+    {
+        enum Type : uint8_t
+        {
+            Include, // #include "name"; name is what's between the quotes
+            Define, // #define name value; value is the rest of the line, less any trailing comment
+        } type;
+
+        // Byte offset into the source of the '#'.
+        int offset;
+
+        NameBufferEntry name;
+        NameBufferEntry value;
+    };
+
+    // Every container allocates from one memory resource: by default, the default resource when the output was made.
+    // Lexing into an output made with an arena keeps the whole of it there, however often the output is reused,
+    // so that it can go with the arena's next release. Copies use the default resource; moves keep the resource.
     struct LexerOutput
     {
-        std::vector<Token> tokens;
-        std::vector<char> names;
-        std::vector<Error> errors;
+        LexerOutput() = default;
+
+        // resource must outlive the output.
+        explicit LexerOutput(std::pmr::memory_resource* resource)
+            : tokens(resource), names(resource), errors(resource), kinds(resource), payloads(resource), offsets(resource),
+              symbols(resource), diagnostics(resource), directives(resource)
+        {
+        }
+
+        std::pmr::vector<Token> tokens;
+        std::pmr::vector<char> names;
+        std::pmr::vector<Error> errors;
+
+        // TokenLayout::Arrays only; parallel to each other, and to offsets.
+        std::pmr::vector<TokenKind> kinds;
+        std::pmr::vector<TokenPayload> payloads;
+
+        // Byte offset into the source of the first character of each token, parallel to tokens (or kinds).
+        // A LineTable built from the same source turns these into line/column pairs.
+        std::pmr::vector<int> offsets;
+
+        // Unique names, when interning into the output's own table. LexerOutput::names is left empty in that case.
+        SymbolTable symbols;
+
+        // Messages for Error::message. Each distinct one is stored once, however many errors share it.
+        SymbolTable diagnostics;
+
+        // In source order, when lexed with LexerOptions::directives.
+        std::pmr::vector<Directive> directives;
+
+        // With LexerOptions::source_names, the source this was lexed from. Name entries below its size index it;
+        // the rest index names, less its size. Empty otherwise, so every entry indexes names.
+        std::string_view source;
+
+        std::pmr::memory_resource* resource() const { return tokens.get_allocator().resource(); }
+
+        std::string_view message(const Error& error) const { return error.message >= 0 ? diagnostics.name(error.message) : std::string_view(); }
+
+        // The text of an identifier's or string literal's name entry, wherever it is kept.
+        std::string_view text(const NameBufferEntry& entry) const
+        {
+            return entry.idx < (int)source.size() ? source.substr(entry.idx, entry.len) : std::string_view(names.data() + entry.idx - source.size(), entry.len);
+        }
+    };
+
+    // Where the batch lexer's input and time went. Each lexer() call given one adds to the counts already in it,
+    // so a single LexerStats can cover a whole corpus; the high-water marks are the largest of any one call.
+    struct LexerStats
+    {
+        uint64_t inputs = 0;
+        uint64_t bytes = 0;
+
+        // Bytes stepped over between tokens.
+        uint64_t whitespace_bytes = 0;
+        uint64_t comment_bytes = 0;
+        uint64_t preprocessor_bytes = 0;
+
+        std::array<uint64_t, Token::EnumCount> tokens_by_type = {};
+        std::array<uint64_t, token_kind::count> tokens_by_kind = {};
+
+        // String literals absorbed into the one before them.
+        uint64_t strings_merged = 0;
+
+        // The most bytes in LexerOutput::names, and the most tokens, of any one output.
+        uint64_t names_high_water = 0;
+        uint64_t tokens_high_water = 0;
+
+        // Set this to also split lexing time between skipping to tokens (seek) and matching them (tokenize, which includes
+        // copying names and merging strings), in ticks of the CPU's timestamp counter. Reading it twice per token costs
+        // far more than the other counts, so it is off unless asked for.
+        bool count_cycles = false;
+        uint64_t seek_cycles = 0;
+        uint64_t tokenize_cycles = 0;
+
+        // Adds other's counts to these.
+        void add(const LexerStats& other);
+    };
+
+    struct LexerOptions
+    {
+        // Identifiers and string literals carry Token::symbol rather than a NameBufferEntry into LexerOutput::names.
+        bool intern_names = false;
+
+        // The table to intern into. If null, each output interns into its own LexerOutput::symbols.
+        // Passing the same table for many files gives IDs that are stable across all of them. It is not thread-safe.
+        SymbolTable* symbols = nullptr;
+
+        // Applies to the batch lexer; LexerStream always hands out whole tokens.
+        TokenLayout layout = TokenLayout::Structs;
+
+        // Skip whatever no tokenizer accepts, record an error for it, and keep lexing, rather than stopping at the first error.
+        // Invalid characters skip the run of invalid bytes they are in, bad numbers the rest of the number,
+        // and unterminated strings the rest of the line.
+        bool recover = false;
+
+        // With recover, stop once the output holds this many errors (a batch's, across all of its files), as at the first
+        // without it; 0 for no limit. Output lexed with a limit is always lexed in one piece, whatever threads asks for.
+        int max_errors = 0;
+
+        // Record #include and #define lines in LexerOutput::directives, for the preprocessor. Other '#' lines are still skipped.
+        bool directives = false;
+
+        // Name entries point straight into the source rather than at a copy in LexerOutput::names, which then only holds
+        // merged string literals. Only for sources that outlive the output, such as mapped files. Ignored with intern_names.
+        bool source_names = false;
+
+        // Lex a source of at least two chunk_min_bytes in up to threads pieces at once, then join them into exactly the output
+        // lexing it in one piece gives. Only lexer() without stats does this; everything else ignores these.
+        int threads = 1;
+        int chunk_min_bytes = 256 * 1024;
+    };
+
+    // The LexerOptions features a lexer is compiled with, for lexer<Config>(). Whatever a config leaves out is compiled out
+    // of the lexer's loop, rather than checked once per token, and the options asking for it are ignored; whatever it keeps
+    // is still up to the options. Only the configs here are compiled into the library.
+    struct LexerConfig
+    {
+        static constexpr bool intern_names = true;
+        static constexpr bool arrays = true; // TokenLayout::Arrays
+        static constexpr bool recover = true;
+        static constexpr bool directives = true;
+        static constexpr bool source_names = true;
+    };
+
+    // Building scripts: directives for the preprocessor and names left in mapped sources, stopping at the first error.
+    struct CompileLexerConfig : LexerConfig
+    {
+        static constexpr bool intern_names = false;
+        static constexpr bool arrays = false;
+        static constexpr bool recover = false;
+    };
+
+    // Editors and linters: every error in a source that is still being edited, so names are always copied or interned.
+    struct DiagnosticsLexerConfig : LexerConfig
+    {
+        static constexpr bool arrays = false;
+        static constexpr bool source_names = false;
+    };
+
+    // Produces tokens on demand, one at a time, from the same scanners the batch lexer uses.
+    // Names, symbols and errors go to the output passed in, exactly as the batch lexer would write them;
+    // the tokens themselves (and their offsets) are only handed back to the caller, who may stop at any point.
+    class LexerStream
+    {
+    public:
+        LexerStream(std::string_view data, LexerOutput& output, const LexerOptions& options = LexerOptions());
+
+        // Produces the next token, with adjacent string literals already merged.
+        // Returns false at the end of input, or after an error has been added to the output (unless LexerOptions::recover is set).
+        bool next(Token* token);
+
+        // Offset of the first character of the token most recently returned by next().
+        int offset() const { return m_offset; }
+
+        bool failed() const { return m_failed; }
+
+    private:
+        std::string_view m_data;
+        int m_position = 0;
+        int m_offset = 0;
+        bool m_failed = false;
+
+        LexerOutput& m_output;
+        LexerOptions m_options;
+        SymbolTable& m_symbols;
+    };
+
+    // Lexes exactly data.size() bytes; the input does not need to be NUL-terminated, and nothing past the end is read.
+    LexerOutput lexer(std::string_view data, LexerOutput&& prev_output = LexerOutput(), const LexerOptions& options = LexerOptions());
+
+    // As above, with only Config's features; lexer<LexerConfig>() is the same as lexer().
+    template <typename Config>
+    LexerOutput lexer(std::string_view data, LexerOutput&& prev_output, const LexerOptions& options);
+
+    // As above, also adding to stats. Lexing without stats is compiled separately, so it pays nothing for them.
+    LexerOutput lexer(std::string_view data, LexerOutput&& prev_output, const LexerOptions& options, LexerStats& stats);
+
+    // Lexes a NUL-terminated string.
+    LexerOutput lexer(const char* data, LexerOutput&& prev_output = LexerOutput(), const LexerOptions& options = LexerOptions());
+
+    // How many pieces lexer() lexes a source of size bytes in at once with options: between 1 and options.threads.
+    int chunk_count(size_t size, const LexerOptions& options);
+
+    // Where one file's share of a LexerBatch is: each pair is a [begin, end) range of the matching LexerOutput member.
+    struct LexerBatchFile
+    {
+        int token_begin;
+        int token_end;
+        int names_begin;
+        int names_end;
+        int error_begin;
+        int error_end;
+        int directive_begin;
+        int directive_end;
     };
 
-    LexerOutput lexer(const char* data, LexerOutput&& prev_output = LexerOutput());
+    // Many files lexed into one output, one after another, in the order given.
+    // Names entries (and symbols, when interning) index the shared buffers, so one pass can walk every file's tokens as one array;
+    // offsets, and the offsets of errors and directives, are still relative to the start of each file's own source.
+    // With LexerOptions::source_names, LexerOutput::source is left empty: an entry below the size of its own file's source
+    // indexes that source, and the rest index names, less that size.
+    struct LexerBatch
+    {
+        LexerBatch() = default;
+
+        // As LexerOutput's; resource must outlive the batch.
+        explicit LexerBatch(std::pmr::memory_resource* resource) : output(resource), files(resource) { }
+
+        LexerOutput output;
+        std::pmr::vector<LexerBatchFile> files;
+    };
+
+    // Lexes every source into prev_batch's storage, which is first cleared but keeps its capacity.
+    // The output is reserved up front from the total size of the sources, so lexing a batch allocates a handful of times.
+    // Without LexerOptions::recover, a file stops at its first error, and the next file is lexed as usual.
+    LexerBatch lex_batch(std::span<const std::string_view> sources, LexerBatch&& prev_batch = LexerBatch(), const LexerOptions& options = LexerOptions());
+
+    // Replaces length bytes at offset with text.
+    struct LexerEdit
+    {
+        int offset;
+        int length;
+        std::string_view text;
+    };
+
+    // Applies edit to source, and brings prev_output (lexed from source before the edit, with the same options) up to date with it.
+    // Only the tokens from just before the edit to where the new tokens line up with the old ones again are lexed;
+    // the rest are kept, with their offsets and names moved to match. TokenLayout::Arrays output, output with directives,
+    // and output with names in the source, is always lexed again in full.
+    LexerOutput relex(std::string& source, const LexerEdit& edit, LexerOutput&& prev_output, const LexerOptions& options = LexerOptions());
 
 #define TREES_TK(str, enum) std::make_pair(std::string_view(str), enum)
 
+    template <typename Table>
+    constexpr bool in_enum_order(const Table& table)
+    {
+        for (size_t i = 0; i < table.size(); ++i)
+        {
+            if ((size_t)table[i].second != i) return false;
+        }
+
+        return true;
+    }
+
     // Must match order of Keyword enum.
     static constexpr inline std::array keywords
     {
@@ -178,7 +526,7 @@ namespace nwtrees
         TREES_TK("vector", Keyword::Vector),
         TREES_TK("void", Keyword::Void),
         TREES_TK("while", Keyword::While),
-    }; static_assert((size_t)Keyword::EnumCount == keywords.size());
+    }; static_assert((size_t)Keyword::EnumCount == keywords.size() && in_enum_order(keywords));
 
     // Must match order of Punctuator enum.
     static constexpr inline std::array punctuators
@@ -229,7 +577,7 @@ namespace nwtrees
         TREES_TK("/", Punctuator::Slash),
         TREES_TK("/=", Punctuator::SlashEquals),
         TREES_TK("~", Punctuator::Tilde),
-    }; static_assert((size_t)Punctuator::EnumCount == punctuators.size());
+    }; static_assert((size_t)Punctuator::EnumCount == punctuators.size() && in_enum_order(punctuators));
 
 #undef TREES_TK
 }
@@ -0,0 +1,40 @@
+#include <nwtrees/LineTable.hpp>
+#include <nwtrees/util/Assert.hpp>
+#include <nwtrees/util/Scan.hpp>
+
+#include <algorithm>
+
+using namespace nwtrees;
+
+void LineTable::build(const std::string_view source)
+{
+    const char* head = source.data();
+    const char* end = head + source.size();
+
+    m_line_starts.clear();
+    m_line_starts.reserve(scan::count_newlines(head, end) + 1);
+    m_line_starts.push_back(0);
+
+    while ((head = scan::find_newline(head, end)) != end)
+    {
+        ++head;
+        m_line_starts.push_back((int)(head - source.data()));
+    }
+}
+
+SourceLocation LineTable::locate(const int offset) const
+{
+    NWTREES_ASSERT(!m_line_starts.empty());
+
+    // The line is the last one starting at or before the offset.
+    const auto iter = std::upper_bound(std::begin(m_line_starts), std::end(m_line_starts), offset);
+    const int line = (int)(iter - std::begin(m_line_starts)) - 1;
+    return { line, offset - m_line_starts[line] };
+}
+
+std::string_view LineTable::line_text(const std::string_view source, const int line) const
+{
+    const size_t start = (size_t)m_line_starts[line];
+    const size_t end = line + 1 < line_count() ? (size_t)m_line_starts[line + 1] - 1 : source.size();
+    return source.substr(start, end - start);
+}
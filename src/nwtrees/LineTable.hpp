@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace nwtrees
+{
+    // Zero-based line and column (in bytes) of a position in a source file.
+    struct SourceLocation
+    {
+        int line;
+        int column;
+    };
+
+    // The start offset of every line in a source file, for turning token and error offsets into line/column pairs.
+    // Building it costs one vectorized pass over the source; each lookup after that is a binary search.
+    class LineTable
+    {
+    public:
+        // Indexes source, replacing whatever was indexed before but keeping the storage.
+        void build(std::string_view source);
+
+        bool empty() const { return m_line_starts.empty(); }
+        int line_count() const { return (int)m_line_starts.size(); }
+        int line_start(const int line) const { return m_line_starts[line]; }
+
+        SourceLocation locate(int offset) const;
+
+        // The text of a line from the source this table was built from, without its line break.
+        std::string_view line_text(std::string_view source, int line) const;
+
+    private:
+        std::vector<int> m_line_starts;
+    };
+}
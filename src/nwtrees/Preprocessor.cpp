@@ -0,0 +1,106 @@
+#include <nwtrees/Preprocessor.hpp>
+
+#include <climits>
+
+using namespace nwtrees;
+
+TranslationUnit::TranslationUnit(const LexedFile& root, IncludeResolver resolve)
+    : m_resolve(std::move(resolve))
+{
+    m_files.push_back(&root);
+    m_included.insert(&root);
+    m_stack.push_back({ &root, 0, 0 });
+}
+
+bool TranslationUnit::next(PreprocessedToken* token)
+{
+    while (true)
+    {
+        // A macro's value is handed out in full before anything else in the file is looked at.
+        if (m_expansion.output)
+        {
+            if (m_expansion.token < m_expansion.output->tokens.size())
+            {
+                *token = { m_expansion.output->tokens[m_expansion.token++], m_expansion.output, m_expansion.file, m_expansion.offset };
+                return true;
+            }
+
+            m_expansion.output = nullptr;
+        }
+
+        if (m_stack.empty()) return false;
+
+        Frame& frame = m_stack.back();
+        const LexerOutput& output = frame.file->output;
+
+        // Directives take effect between the tokens they were found between.
+        const int next_offset = frame.token < output.offsets.size() ? output.offsets[frame.token] : INT_MAX;
+
+        if (frame.directive < output.directives.size() && output.directives[frame.directive].offset < next_offset)
+        {
+            // This may push a frame, so frame isn't used again this iteration.
+            const Directive& directive = output.directives[frame.directive++];
+            apply(*frame.file, directive);
+            continue;
+        }
+
+        if (frame.token == output.tokens.size())
+        {
+            m_stack.pop_back();
+            continue;
+        }
+
+        const size_t idx = frame.token++;
+        const Token& next_token = output.tokens[idx];
+
+        if (next_token.type == Token::Identifier && !m_macros.empty())
+        {
+            const NameBufferEntry& entry = next_token.identifier_data;
+            const int macro = m_macro_names.find(output.text(entry));
+
+            if (macro >= 0)
+            {
+                m_expansion = { m_macros[macro], 0, frame.file, output.offsets[idx] };
+                continue;
+            }
+        }
+
+        *token = { next_token, &output, frame.file, output.offsets[idx] };
+        return true;
+    }
+}
+
+void TranslationUnit::apply(const LexedFile& file, const Directive& directive)
+{
+    const std::string_view name(file.source.data() + directive.name.idx, directive.name.len);
+
+    if (directive.type == Directive::Include)
+    {
+        const LexedFile* included = m_resolve(name, file);
+
+        if (!included)
+        {
+            m_errors.push_back({ &file, Error(Error::MissingInclude, directive.offset, m_diagnostics.intern(name)) });
+        }
+        else if (m_included.insert(included).second)
+        {
+            m_files.push_back(included);
+            m_stack.push_back({ included, 0, 0 });
+        }
+
+        return;
+    }
+
+    // A redefinition replaces the value from here on, but the old one is kept for the tokens already taken from it.
+    const int macro = m_macro_names.intern(name);
+    if (macro == (int)m_macros.size()) m_macros.emplace_back();
+
+    const LexerOutput& value = m_definitions.emplace_back(lexer(file.source.substr(directive.value.idx, directive.value.len)));
+    m_macros[macro] = &value;
+
+    for (const Error& error : value.errors)
+    {
+        const std::string_view message = value.message(error);
+        m_errors.push_back({ &file, Error(error.code, directive.value.idx + error.offset, message.empty() ? -1 : m_diagnostics.intern(message)) });
+    }
+}
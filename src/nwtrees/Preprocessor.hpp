@@ -0,0 +1,107 @@
+#pragma once
+
+#include <nwtrees/Lexer.hpp>
+#include <nwtrees/SymbolTable.hpp>
+#include <nwtrees/util/Error.hpp>
+
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace nwtrees
+{
+    // A source file and the result of lexing it with LexerOptions::directives (and without intern_names).
+    // After it is lexed, it is only ever read, so one file can be shared by any number of translation units, on any number of threads.
+    struct LexedFile
+    {
+        // For diagnostics only; owned by whoever made the file.
+        std::string_view name;
+        std::string_view source;
+        LexerOutput output;
+    };
+
+    struct PreprocessedToken
+    {
+        Token token;
+
+        // Where the token's names are, read with LexerOutput::text. This is the file's output, or for a token substituted from a macro, the macro's.
+        // Either lasts as long as the translation unit does.
+        const LexerOutput* output;
+
+        // Where the token was found: for a substituted token, the use of the macro.
+        const LexedFile* file;
+        int offset;
+    };
+
+    struct PreprocessorError
+    {
+        const LexedFile* file;
+        Error error;
+    };
+
+    // Maps the name in an #include "name" in from to the file it names, or null if there is no such file.
+    // The file must outlive the translation unit.
+    using IncludeResolver = std::function<const LexedFile*(std::string_view name, const LexedFile& from)>;
+
+    // The tokens of a script with its #includes and #defines applied, produced on demand.
+    //
+    // As in the game's own compiler, each file is included at most once per translation unit; later #includes of it
+    // (including ones that would make a cycle) are ignored. Macros are object-like only: from its #define on, an identifier
+    // that names a macro is replaced with the tokens of its value, and those tokens are not themselves expanded again.
+    class TranslationUnit
+    {
+    public:
+        TranslationUnit(const LexedFile& root, IncludeResolver resolve);
+
+        // Produces the next token. Returns false once every included file has been exhausted.
+        bool next(PreprocessedToken* token);
+
+        // Every file included so far, root first, in the order they were first included.
+        const std::vector<const LexedFile*>& files() const { return m_files; }
+
+        const std::vector<PreprocessorError>& errors() const { return m_errors; }
+
+        std::string_view message(const PreprocessorError& error) const
+        {
+            return error.error.message >= 0 ? m_diagnostics.name(error.error.message) : std::string_view();
+        }
+
+    private:
+        struct Frame
+        {
+            const LexedFile* file;
+            size_t token;
+            size_t directive;
+        };
+
+        struct Expansion
+        {
+            const LexerOutput* output = nullptr;
+            size_t token = 0;
+            const LexedFile* file = nullptr;
+            int offset = 0;
+        };
+
+        void apply(const LexedFile& file, const Directive& directive);
+
+        IncludeResolver m_resolve;
+
+        std::vector<Frame> m_stack;
+        std::vector<const LexedFile*> m_files;
+        std::unordered_set<const LexedFile*> m_included;
+
+        // Every value any macro has had, in the order they were defined. A redefinition adds another, rather than
+        // replacing the old one, so tokens handed out from it stay valid; a deque never moves what it holds.
+        std::deque<LexerOutput> m_definitions;
+
+        // The current definition of each macro, indexed by the ID of its name.
+        SymbolTable m_macro_names;
+        std::vector<const LexerOutput*> m_macros;
+        Expansion m_expansion;
+
+        std::vector<PreprocessorError> m_errors;
+        SymbolTable m_diagnostics;
+    };
+}
@@ -0,0 +1,83 @@
+#include <nwtrees/Snapshot.hpp>
+#include <nwtrees/util/Hash.hpp>
+
+#include <bit>
+
+using namespace nwtrees;
+
+namespace
+{
+    // The generated data is written as calls to this, so that tokens are constants rather than built at startup.
+    // a and b are the payload's two ints: the name entry's idx and len, or a number's bits in a.
+    constexpr Token snapshot_token(const TokenKind kind, const int a, const int b)
+    {
+        Token token = {};
+        token.type = token_kind::type(kind);
+
+        switch (token.type)
+        {
+            case Token::Keyword:
+                token.keyword = (Keyword)(kind - token_kind::first_keyword);
+                break;
+
+            case Token::Literal:
+                token.literal = (Literal)(kind - token_kind::first_literal);
+
+                if (token.literal == Literal::Int) token.literal_data.integer = a;
+                else if (token.literal == Literal::Float) token.literal_data.flt = std::bit_cast<float>(a);
+                else token.literal_data.str = { a, b };
+                break;
+
+            case Token::Punctuator:
+                token.punctuator = (Punctuator)(kind - token_kind::first_punctuator);
+                break;
+
+            default:
+                token.identifier_data = { a, b };
+                break;
+        }
+
+        return token;
+    }
+
+#if defined(NWTREES_NWSCRIPT_SNAPSHOT)
+    // Written by nwtrees_snapshot; defines nwscript, a LexerSnapshot.
+    #include "nwscript_snapshot.inc"
+#endif
+}
+
+bool LexerSnapshot::matches(const std::string_view source) const
+{
+    return source.size() == source_size && hash::xxh64(source) == source_hash;
+}
+
+const LexerSnapshot* nwtrees::nwscript_snapshot()
+{
+#if defined(NWTREES_NWSCRIPT_SNAPSHOT)
+    return &nwscript;
+#else
+    return nullptr;
+#endif
+}
+
+bool nwtrees::load_snapshot(const LexerSnapshot& snapshot, const std::string_view source, LexerOutput& output, const LexerOptions& options)
+{
+    if (options.intern_names || options.layout != TokenLayout::Structs || !snapshot.matches(source)) return false;
+
+    output.tokens.assign(std::begin(snapshot.tokens), std::end(snapshot.tokens));
+    output.offsets.assign(std::begin(snapshot.offsets), std::end(snapshot.offsets));
+    output.names.assign(std::begin(snapshot.names), std::end(snapshot.names));
+
+    // Directives are only ever recorded, never lexed differently, so leaving them out is all that's needed without them.
+    if (options.directives) output.directives.assign(std::begin(snapshot.directives), std::end(snapshot.directives));
+    else output.directives.clear();
+
+    // A snapshot is only made of a file that lexes cleanly.
+    output.errors.clear();
+    output.diagnostics.clear();
+    output.kinds.clear();
+    output.payloads.clear();
+    output.symbols.clear();
+    output.source = std::string_view();
+    return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <nwtrees/Lexer.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace nwtrees
+{
+    // A file lexed while the library was built, kept as constant data: what LexerOutput would hold after lexing it
+    // with LexerOptions::directives and otherwise default options. Reading it costs neither lexing nor allocation.
+    struct LexerSnapshot
+    {
+        // The file's name, without its directory.
+        std::string_view name;
+
+        // The source it was lexed from, to tell whether a file on disk is still the same one.
+        size_t source_size;
+        uint64_t source_hash; // hash::xxh64
+
+        std::span<const Token> tokens;
+        std::span<const int> offsets;
+        std::string_view names;
+        std::span<const Directive> directives;
+
+        bool matches(std::string_view source) const;
+    };
+
+    // nwscript.nss, when the library was built with NWTREES_NWSCRIPT pointing at one; null otherwise.
+    const LexerSnapshot* nwscript_snapshot();
+
+    // Replaces output's tokens, offsets, names and directives with snapshot's, if source is what it was made from, and lexing
+    // it with options would give the same output. Returns false, leaving output as it was, otherwise.
+    // Interned names and TokenLayout::Arrays never match; with LexerOptions::source_names, names are still copied.
+    bool load_snapshot(const LexerSnapshot& snapshot, std::string_view source, LexerOutput& output, const LexerOptions& options = LexerOptions());
+}
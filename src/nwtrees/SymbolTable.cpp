@@ -0,0 +1,87 @@
+#include <nwtrees/SymbolTable.hpp>
+#include <nwtrees/util/Hash.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace nwtrees;
+
+int SymbolTable::intern(const std::string_view str)
+{
+    // Keep the load factor at or below one half so probe sequences stay short.
+    if ((m_entries.size() + 1) * 2 > m_slots.size())
+    {
+        grow();
+    }
+
+    const uint32_t hash = hash::fnv1a(str);
+    const size_t mask = m_slots.size() - 1;
+
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        const int id = m_slots[slot] - 1;
+
+        if (id < 0)
+        {
+            const int new_id = (int)m_entries.size();
+            const size_t new_idx = m_names.size();
+            m_names.resize(new_idx + str.size());
+            std::memcpy(m_names.data() + new_idx, str.data(), str.size());
+            m_entries.push_back({ (int)new_idx, (int)str.size(), hash });
+            m_slots[slot] = new_id + 1;
+            return new_id;
+        }
+
+        const Entry& entry = m_entries[id];
+
+        if (entry.hash == hash && (size_t)entry.len == str.size() &&
+            std::memcmp(m_names.data() + entry.idx, str.data(), str.size()) == 0)
+        {
+            return id;
+        }
+    }
+}
+
+int SymbolTable::find(const std::string_view str) const
+{
+    if (m_entries.empty()) return -1;
+
+    const uint32_t hash = hash::fnv1a(str);
+    const size_t mask = m_slots.size() - 1;
+
+    for (size_t slot = hash & mask; ; slot = (slot + 1) & mask)
+    {
+        const int id = m_slots[slot] - 1;
+        if (id < 0) return -1;
+
+        const Entry& entry = m_entries[id];
+
+        if (entry.hash == hash && (size_t)entry.len == str.size() &&
+            std::memcmp(m_names.data() + entry.idx, str.data(), str.size()) == 0)
+        {
+            return id;
+        }
+    }
+}
+
+void SymbolTable::clear()
+{
+    m_names.clear();
+    m_entries.clear();
+    std::fill(std::begin(m_slots), std::end(m_slots), 0);
+}
+
+void SymbolTable::grow()
+{
+    const size_t new_size = std::max<size_t>(64, m_slots.size() * 2);
+    m_slots.assign(new_size, 0);
+
+    const size_t mask = new_size - 1;
+
+    for (int id = 0; id < (int)m_entries.size(); ++id)
+    {
+        size_t slot = m_entries[id].hash & mask;
+        while (m_slots[slot]) slot = (slot + 1) & mask;
+        m_slots[slot] = id + 1;
+    }
+}
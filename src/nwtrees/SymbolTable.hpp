@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace nwtrees
+{
+    // Stores each unique string once and hands out dense IDs, in first-seen order, starting at zero.
+    // Two strings have the same ID if and only if they are equal, so later passes can compare names as integers.
+    class SymbolTable
+    {
+    public:
+        SymbolTable() = default;
+
+        // Everything the table holds is allocated from resource, which must outlive it.
+        explicit SymbolTable(std::pmr::memory_resource* resource) : m_names(resource), m_entries(resource), m_slots(resource) { }
+
+        int intern(std::string_view str);
+
+        // The ID str was interned as, or -1 if it hasn't been.
+        int find(std::string_view str) const;
+
+        std::string_view name(const int symbol) const
+        {
+            const Entry& entry = m_entries[symbol];
+            return { m_names.data() + entry.idx, (size_t)entry.len };
+        }
+
+        int size() const { return (int)m_entries.size(); }
+
+        // Forgets every symbol but keeps the storage, so a recycled table doesn't reallocate.
+        void clear();
+
+        // All unique strings, back to back.
+        const std::pmr::vector<char>& names() const { return m_names; }
+
+    private:
+        struct Entry
+        {
+            int idx;
+            int len;
+            uint32_t hash;
+        };
+
+        void grow();
+
+        std::pmr::vector<char> m_names;
+        std::pmr::vector<Entry> m_entries;
+        std::pmr::vector<int> m_slots; // open addressing; each slot holds ID + 1, or 0 if empty
+    };
+}
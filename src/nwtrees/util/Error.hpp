@@ -1,21 +1,38 @@
 #pragma once
 
-#include <string>
-#include <vector>
-
 namespace nwtrees
 {
+    // A compact diagnostic: what went wrong, and where. Anything more is interned by whoever produced it
+    // (for the lexer, LexerOutput::diagnostics), so errors themselves never allocate.
     struct Error
     {
         enum Code
         {
             Unknown,
+            InvalidCharacter,
+            UnterminatedString,
+            InvalidNumber,
+            MissingInclude,
         } code;
 
-        std::vector<std::string> messages;
+        // Byte offset into the source at which the error was found.
+        int offset = 0;
+
+        // ID of a message with extra detail, in the producer's message table; -1 if there is none.
+        int message = -1;
 
-        Error(const Code code_) : code(code_) { }
-        Error(const Code code_, const std::string& message_) : code(code_), messages({message_}) { }
-        Error(const Code code_, const std::vector<std::string>& messages_) : code(code_), messages(messages_) { }
+        Error(const Code code_, const int offset_, const int message_ = -1) : code(code_), offset(offset_), message(message_) { }
+
+        static const char* describe(const Code code)
+        {
+            switch (code)
+            {
+                case InvalidCharacter: return "invalid character";
+                case UnterminatedString: return "unterminated string";
+                case InvalidNumber: return "invalid number";
+                case MissingInclude: return "missing include";
+                default: return "unknown token";
+            }
+        }
     };
 }
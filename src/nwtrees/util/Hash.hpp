@@ -0,0 +1,114 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace nwtrees::hash
+{
+    // FNV-1a: cheap and good enough for the short keys (identifiers, file names) it is used on.
+    inline uint32_t fnv1a(const std::string_view str)
+    {
+        uint32_t hash = 2166136261u;
+
+        for (const char ch : str)
+        {
+            hash = (hash ^ (uint8_t)ch) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    namespace detail
+    {
+        static constexpr uint64_t xxh64_prime1 = 11400714785074694791ull;
+        static constexpr uint64_t xxh64_prime2 = 14029467366897019727ull;
+        static constexpr uint64_t xxh64_prime3 = 1609587929392839161ull;
+        static constexpr uint64_t xxh64_prime4 = 9650029242287828579ull;
+        static constexpr uint64_t xxh64_prime5 = 2870177450012600261ull;
+
+        // Little-endian reads; every platform we build for is little-endian.
+        inline uint64_t read64(const char* data) { uint64_t value; std::memcpy(&value, data, sizeof(value)); return value; }
+        inline uint32_t read32(const char* data) { uint32_t value; std::memcpy(&value, data, sizeof(value)); return value; }
+
+        inline uint64_t xxh64_round(uint64_t acc, const uint64_t input)
+        {
+            acc += input * xxh64_prime2;
+            return std::rotl(acc, 31) * xxh64_prime1;
+        }
+
+        inline uint64_t xxh64_merge(uint64_t acc, const uint64_t value)
+        {
+            acc ^= xxh64_round(0, value);
+            return acc * xxh64_prime1 + xxh64_prime4;
+        }
+    }
+
+    // XXH64: for whole files, where FNV-1a's byte at a time would cost more than the work it saves.
+    inline uint64_t xxh64(const std::string_view str, const uint64_t seed = 0)
+    {
+        using namespace detail;
+
+        const char* head = str.data();
+        const char* const end = head + str.size();
+
+        uint64_t hash;
+
+        if (str.size() >= 32)
+        {
+            uint64_t v1 = seed + xxh64_prime1 + xxh64_prime2;
+            uint64_t v2 = seed + xxh64_prime2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - xxh64_prime1;
+
+            for (; end - head >= 32; head += 32)
+            {
+                v1 = xxh64_round(v1, read64(head));
+                v2 = xxh64_round(v2, read64(head + 8));
+                v3 = xxh64_round(v3, read64(head + 16));
+                v4 = xxh64_round(v4, read64(head + 24));
+            }
+
+            hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+            hash = xxh64_merge(hash, v1);
+            hash = xxh64_merge(hash, v2);
+            hash = xxh64_merge(hash, v3);
+            hash = xxh64_merge(hash, v4);
+        }
+        else
+        {
+            hash = seed + xxh64_prime5;
+        }
+
+        hash += str.size();
+
+        for (; end - head >= 8; head += 8)
+        {
+            hash ^= xxh64_round(0, read64(head));
+            hash = std::rotl(hash, 27) * xxh64_prime1 + xxh64_prime4;
+        }
+
+        if (end - head >= 4)
+        {
+            hash ^= read32(head) * xxh64_prime1;
+            hash = std::rotl(hash, 23) * xxh64_prime2 + xxh64_prime3;
+            head += 4;
+        }
+
+        for (; head < end; ++head)
+        {
+            hash ^= (uint8_t)*head * xxh64_prime5;
+            hash = std::rotl(hash, 11) * xxh64_prime1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= xxh64_prime2;
+        hash ^= hash >> 29;
+        hash *= xxh64_prime3;
+        hash ^= hash >> 32;
+
+        return hash;
+    }
+}
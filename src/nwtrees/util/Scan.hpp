@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// The backend is normally chosen by NWTREES_SIMD in CMakeLists.txt; if nothing was chosen, detect from the compiler.
+#if !defined(NWTREES_SIMD_SCALAR) && !defined(NWTREES_SIMD_SSE2) && !defined(NWTREES_SIMD_AVX2) && !defined(NWTREES_SIMD_NEON)
+    #if defined(__AVX2__)
+        #define NWTREES_SIMD_AVX2
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define NWTREES_SIMD_SSE2
+    #elif defined(__ARM_NEON) || defined(_M_ARM64)
+        #define NWTREES_SIMD_NEON
+    #else
+        #define NWTREES_SIMD_SCALAR
+    #endif
+#endif
+
+#if defined(NWTREES_SIMD_AVX2)
+    #include <immintrin.h>
+#elif defined(NWTREES_SIMD_SSE2)
+    #include <emmintrin.h>
+#elif defined(NWTREES_SIMD_NEON)
+    #include <arm_neon.h>
+#endif
+
+// Skip routines used by the lexer to step over whitespace, comments and preprocessor lines.
+// All of them scan [head, end) and return end if they run out of input; no terminator is needed.
+//
+// The vector backends only ever load whole aligned blocks that contain at least one byte of the input.
+// An aligned block never straddles a page boundary, so reading past either end of the input cannot fault,
+// even when the input ends exactly at the end of a mapping.
+
+namespace nwtrees::scan
+{
+    // Returns the first '\n' at or after head.
+    inline const char* find_newline(const char* head, const char* end);
+
+    // Returns the first '\"' or '\n' at or after head.
+    inline const char* find_string_end(const char* head, const char* end);
+
+    // Returns the '/' of the first "*/" whose '*' is at or after head.
+    inline const char* find_comment_end(const char* head, const char* end);
+
+    // Returns the first non-whitespace byte at or after head.
+    inline const char* skip_whitespace(const char* head, const char* end);
+
+    // Returns the number of '\n' in [head, end).
+    inline size_t count_newlines(const char* head, const char* end);
+
+    // Name of the backend selected at build time.
+    inline const char* backend_name();
+
+    namespace scalar
+    {
+        inline bool is_whitespace(const char ch) { return ch == ' ' || (ch >= '\t' && ch <= '\r'); }
+
+        inline const char* find_newline(const char* head, const char* end)
+        {
+            while (head < end && *head != '\n') ++head;
+            return head;
+        }
+
+        inline const char* find_string_end(const char* head, const char* end)
+        {
+            while (head < end && *head != '\"' && *head != '\n') ++head;
+            return head;
+        }
+
+        inline const char* find_comment_end(const char* head, const char* end)
+        {
+            if (head >= end) return end;
+
+            for (++head; head < end; ++head)
+            {
+                if (*head == '/' && head[-1] == '*') break;
+            }
+
+            return head;
+        }
+
+        inline const char* skip_whitespace(const char* head, const char* end)
+        {
+            while (head < end && is_whitespace(*head)) ++head;
+            return head;
+        }
+
+        inline size_t count_newlines(const char* head, const char* end)
+        {
+            size_t count = 0;
+            for (; head < end; ++head) count += *head == '\n';
+            return count;
+        }
+    }
+
+#if defined(NWTREES_SIMD_SCALAR)
+    inline const char* find_newline(const char* head, const char* end) { return scalar::find_newline(head, end); }
+    inline const char* find_string_end(const char* head, const char* end) { return scalar::find_string_end(head, end); }
+    inline const char* find_comment_end(const char* head, const char* end) { return scalar::find_comment_end(head, end); }
+    inline const char* skip_whitespace(const char* head, const char* end) { return scalar::skip_whitespace(head, end); }
+    inline size_t count_newlines(const char* head, const char* end) { return scalar::count_newlines(head, end); }
+    inline const char* backend_name() { return "scalar"; }
+#else
+    namespace simd
+    {
+    #if defined(NWTREES_SIMD_AVX2)
+        using Block = __m256i;
+        static constexpr size_t block_size = 32;
+        static constexpr int bits_per_byte = 1;
+
+        inline Block load(const char* head) { return _mm256_load_si256((const __m256i*)head); }
+        inline Block eq(const Block v, const char ch) { return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch)); }
+        inline Block either(const Block lhs, const Block rhs) { return _mm256_or_si256(lhs, rhs); }
+        inline uint64_t mask(const Block v) { return (uint32_t)_mm256_movemask_epi8(v); }
+
+        inline Block whitespace(const Block v)
+        {
+            // '\t' to '\r' are contiguous: after subtracting '\t', they are exactly the bytes <= 4.
+            const Block shifted = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+            const Block control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+            return either(control, eq(v, ' '));
+        }
+
+        inline uint64_t inverted_mask(const Block v) { return ~mask(v) & 0xFFFFFFFFull; }
+    #elif defined(NWTREES_SIMD_SSE2)
+        using Block = __m128i;
+        static constexpr size_t block_size = 16;
+        static constexpr int bits_per_byte = 1;
+
+        inline Block load(const char* head) { return _mm_load_si128((const __m128i*)head); }
+        inline Block eq(const Block v, const char ch) { return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch)); }
+        inline Block either(const Block lhs, const Block rhs) { return _mm_or_si128(lhs, rhs); }
+        inline uint64_t mask(const Block v) { return (uint32_t)_mm_movemask_epi8(v); }
+
+        inline Block whitespace(const Block v)
+        {
+            const Block shifted = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+            const Block control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+            return either(control, eq(v, ' '));
+        }
+
+        inline uint64_t inverted_mask(const Block v) { return ~mask(v) & 0xFFFFull; }
+    #elif defined(NWTREES_SIMD_NEON)
+        using Block = uint8x16_t;
+        static constexpr size_t block_size = 16;
+        static constexpr int bits_per_byte = 4;
+
+        inline Block load(const char* head) { return vld1q_u8((const uint8_t*)head); }
+        inline Block eq(const Block v, const char ch) { return vceqq_u8(v, vdupq_n_u8((uint8_t)ch)); }
+        inline Block either(const Block lhs, const Block rhs) { return vorrq_u8(lhs, rhs); }
+
+        inline uint64_t mask(const Block v)
+        {
+            // NEON has no movemask; narrowing each 16-bit lane by 4 leaves one nibble per byte.
+            const uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+            return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0);
+        }
+
+        inline Block whitespace(const Block v)
+        {
+            const Block control = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4));
+            return either(control, eq(v, ' '));
+        }
+
+        inline uint64_t inverted_mask(const Block v) { return mask(vmvnq_u8(v)); }
+    #endif
+
+        // Calls match(block) for each aligned block from the one containing head, and returns the first byte
+        // in [head, end) whose bit is set in the returned mask, or end if there is none.
+        template <typename Match>
+        inline const char* find(const char* head, const char* end, Match match)
+        {
+            if (head >= end) return end;
+
+            const char* block = (const char*)((uintptr_t)head & ~(uintptr_t)(block_size - 1));
+            const int skip = (int)(head - block) * bits_per_byte;
+
+            uint64_t bits = match(load(block)) >> skip;
+            if (bits) return std::min(head + std::countr_zero(bits) / bits_per_byte, end);
+
+            for (block += block_size; block < end; block += block_size)
+            {
+                bits = match(load(block));
+                if (bits) return std::min(block + std::countr_zero(bits) / bits_per_byte, end);
+            }
+
+            return end;
+        }
+
+        // Counts the bytes in [head, end) whose bits are set in the masks returned by match(block).
+        template <typename Match>
+        inline size_t count(const char* head, const char* end, Match match)
+        {
+            if (head >= end) return 0;
+
+            const char* block = (const char*)((uintptr_t)head & ~(uintptr_t)(block_size - 1));
+            const int skip = (int)(head - block) * bits_per_byte;
+
+            size_t total = 0;
+
+            for (uint64_t keep = ~0ull << skip; block < end; block += block_size, keep = ~0ull)
+            {
+                const int valid = (int)std::min<ptrdiff_t>(end - block, block_size) * bits_per_byte;
+                if (valid < 64) keep &= (1ull << valid) - 1;
+                total += std::popcount(match(load(block)) & keep);
+            }
+
+            return total / bits_per_byte;
+        }
+    }
+
+    inline const char* find_newline(const char* head, const char* end)
+    {
+        return simd::find(head, end, [](const simd::Block v)
+        {
+            return simd::mask(simd::eq(v, '\n'));
+        });
+    }
+
+    inline const char* find_string_end(const char* head, const char* end)
+    {
+        return simd::find(head, end, [](const simd::Block v)
+        {
+            return simd::mask(simd::either(simd::eq(v, '\"'), simd::eq(v, '\n')));
+        });
+    }
+
+    inline const char* find_comment_end(const char* head, const char* end)
+    {
+        if (head >= end) return end;
+
+        const auto slash = [](const simd::Block v)
+        {
+            return simd::mask(simd::eq(v, '/'));
+        };
+
+        for (++head; ; ++head)
+        {
+            head = simd::find(head, end, slash);
+            if (head == end || head[-1] == '*') return head;
+        }
+    }
+
+    inline const char* skip_whitespace(const char* head, const char* end)
+    {
+        // Most runs are a single space between tokens; don't pay for a vector load for those.
+        if (head == end || !scalar::is_whitespace(*head)) return head;
+        if (++head == end || !scalar::is_whitespace(*head)) return head;
+
+        return simd::find(head, end, [](const simd::Block v)
+        {
+            return simd::inverted_mask(simd::whitespace(v));
+        });
+    }
+
+    inline size_t count_newlines(const char* head, const char* end)
+    {
+        return simd::count(head, end, [](const simd::Block v)
+        {
+            return simd::mask(simd::eq(v, '\n'));
+        });
+    }
+
+    inline const char* backend_name()
+    {
+    #if defined(NWTREES_SIMD_AVX2)
+        return "avx2";
+    #elif defined(NWTREES_SIMD_SSE2)
+        return "sse2";
+    #elif defined(NWTREES_SIMD_NEON)
+        return "neon";
+    #endif
+    }
+#endif
+}
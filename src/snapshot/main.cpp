@@ -0,0 +1,163 @@
+// Build step: lexes one file, and writes the result out as C++ data for src/nwtrees/Snapshot.cpp to compile in.
+// Usage: nwtrees_snapshot <file.nss> <output.inc>
+
+#include <nwtrees/Lexer.hpp>
+#include <nwtrees/LineTable.hpp>
+#include <nwtrees/util/Hash.hpp>
+
+#include <bit>
+#include <filesystem>
+#include <stdio.h>
+#include <string>
+
+namespace
+{
+    bool read_file(const char* path, std::string& data);
+    void write_char(FILE* out, char ch);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        printf("Usage: nwtrees_snapshot <file.nss> <output.inc>\n");
+        return 1;
+    }
+
+    std::string source;
+
+    if (!read_file(argv[1], source))
+    {
+        printf("ERROR: %s: could not be read\n", argv[1]);
+        return 1;
+    }
+
+    nwtrees::LexerOptions options;
+    options.directives = true;
+    options.recover = true;
+
+    const nwtrees::LexerOutput output = nwtrees::lexer(std::string_view(source), nwtrees::LexerOutput(), options);
+
+    // Snapshots are loaded as if lexed without errors, so a file with any can't have one.
+    if (!output.errors.empty())
+    {
+        nwtrees::LineTable lines;
+        lines.build(source);
+
+        for (const nwtrees::Error& error : output.errors)
+        {
+            const nwtrees::SourceLocation location = lines.locate(error.offset);
+            printf("ERROR: %s(%d,%d): %s: %.*s\n", argv[1], location.line + 1, location.column + 1, nwtrees::Error::describe(error.code),
+                (int)output.message(error).size(), output.message(error).data());
+        }
+
+        return 1;
+    }
+
+    FILE* out = fopen(argv[2], "w");
+
+    if (!out)
+    {
+        printf("ERROR: %s: could not be written\n", argv[2]);
+        return 1;
+    }
+
+    const std::string name = std::filesystem::path(argv[1]).filename().string();
+
+    fprintf(out, "// Generated by nwtrees_snapshot from %s (lexer version %u). Do not edit.\n\n", name.c_str(), nwtrees::lexer_version);
+
+    // Arrays can't be empty, so each gets a spare element at the end; the spans only cover the ones before it.
+
+    fprintf(out, "constexpr Token nwscript_tokens[] =\n{");
+    for (size_t i = 0; i < output.tokens.size(); ++i)
+    {
+        const nwtrees::Token& token = output.tokens[i];
+        const nwtrees::TokenPayload payload = nwtrees::payload_of(token);
+
+        int a = 0;
+        int b = 0;
+
+        if (token.type == nwtrees::Token::Identifier || (token.type == nwtrees::Token::Literal && token.literal == nwtrees::Literal::String))
+        {
+            a = payload.identifier_data.idx;
+            b = payload.identifier_data.len;
+        }
+        else if (token.type == nwtrees::Token::Literal)
+        {
+            a = token.literal == nwtrees::Literal::Int ? payload.literal_data.integer : std::bit_cast<int>(payload.literal_data.flt);
+        }
+
+        fprintf(out, "%ssnapshot_token(%d, %d, %d),", i % 4 ? " " : "\n    ", nwtrees::token_kind::of(token), a, b);
+    }
+    fprintf(out, "\n    {}\n};\n\n");
+
+    fprintf(out, "constexpr int nwscript_offsets[] =\n{");
+    for (size_t i = 0; i < output.offsets.size(); ++i)
+    {
+        fprintf(out, "%s%d,", i % 16 ? " " : "\n    ", output.offsets[i]);
+    }
+    fprintf(out, "\n    0\n};\n\n");
+
+    fprintf(out, "constexpr char nwscript_names[] =\n{");
+    for (size_t i = 0; i < output.names.size(); ++i)
+    {
+        fprintf(out, "%s", i % 16 ? " " : "\n    ");
+        write_char(out, output.names[i]);
+        fprintf(out, ",");
+    }
+    fprintf(out, "\n    0\n};\n\n");
+
+    fprintf(out, "constexpr Directive nwscript_directives[] =\n{\n");
+    for (const nwtrees::Directive& directive : output.directives)
+    {
+        fprintf(out, "    { (Directive::Type)%d, %d, { %d, %d }, { %d, %d } },\n", directive.type, directive.offset,
+            directive.name.idx, directive.name.len, directive.value.idx, directive.value.len);
+    }
+    fprintf(out, "    {}\n};\n\n");
+
+    fprintf(out, "constexpr LexerSnapshot nwscript =\n{\n");
+    fprintf(out, "    \"%s\",\n", name.c_str());
+    fprintf(out, "    %zu,\n", source.size());
+    fprintf(out, "    %lluull,\n", (unsigned long long)nwtrees::hash::xxh64(source));
+    fprintf(out, "    { nwscript_tokens, %zu },\n", output.tokens.size());
+    fprintf(out, "    { nwscript_offsets, %zu },\n", output.offsets.size());
+    fprintf(out, "    { nwscript_names, %zu },\n", output.names.size());
+    fprintf(out, "    { nwscript_directives, %zu },\n", output.directives.size());
+    fprintf(out, "};\n");
+
+    if (fclose(out) != 0)
+    {
+        printf("ERROR: %s: could not be written\n", argv[2]);
+        return 1;
+    }
+
+    return 0;
+}
+
+namespace
+{
+    bool read_file(const char* path, std::string& data)
+    {
+        FILE* file = fopen(path, "rb");
+        if (!file) return false;
+
+        char buffer[64 * 1024];
+        size_t read;
+
+        while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        {
+            data.append(buffer, read);
+        }
+
+        const bool failed = ferror(file);
+        fclose(file);
+        return !failed;
+    }
+
+    // As a character literal, so it means the same whether char is signed or not.
+    void write_char(FILE* out, const char ch)
+    {
+        if (ch >= ' ' && ch <= '~' && ch != '\'' && ch != '\\') fprintf(out, "'%c'", ch);
+        else fprintf(out, "'\\x%02x'", (unsigned char)ch);
+    }
+}
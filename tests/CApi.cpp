@@ -0,0 +1,136 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/CApi.h>
+
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+extern "C" int capi_count_tokens_from_c(const char* source);
+
+namespace
+{
+    struct Storage
+    {
+        std::vector<nwtrees_token> tokens;
+        std::vector<char> names;
+        std::vector<nwtrees_error> errors;
+        nwtrees_buffers buffers;
+
+        Storage(const size_t token_capacity, const size_t name_capacity, const size_t error_capacity)
+            : tokens(token_capacity), names(name_capacity), errors(error_capacity)
+        {
+            buffers = { tokens.data(), tokens.size(), names.data(), names.size(), errors.data(), errors.size(), 0, 0, 0 };
+        }
+
+        std::string_view name(const size_t idx) const
+        {
+            return std::string_view(names.data() + tokens[idx].value.name.idx, tokens[idx].value.name.len);
+        }
+    };
+}
+
+TEST_CLASS(CApi)
+{
+    TEST_METHOD(Lex)
+    {
+        const std::string_view source = "void main() { int nFoo = 0x1F; string s = \"one \" \"two\"; }";
+
+        nwtrees_lexer* lexer = nwtrees_lexer_create(1024, 1);
+        TEST_EXPECT(lexer);
+
+        Storage storage(64, 64, 4);
+        nwtrees_status status;
+
+        {
+            TEST_EXPECT_NO_ALLOC();
+            status = nwtrees_lex(lexer, source.data(), source.size(), &storage.buffers);
+        }
+
+        TEST_EXPECT(status == NWTREES_OK);
+        TEST_EXPECT(storage.buffers.token_count == 16);
+        TEST_EXPECT(storage.buffers.error_count == 0);
+        TEST_EXPECT(strcmp(nwtrees_kind_name(storage.tokens[0].kind), "void") == 0);
+        TEST_EXPECT(storage.tokens[1].kind == NWTREES_KIND_IDENTIFIER);
+        TEST_EXPECT(storage.name(1) == "main");
+        TEST_EXPECT(storage.tokens[8].kind == NWTREES_KIND_INT);
+        TEST_EXPECT(storage.tokens[8].value.integer == 0x1F);
+        TEST_EXPECT(storage.tokens[8].offset == 25);
+
+        // Merged, and copied out like every other name.
+        TEST_EXPECT(storage.tokens[13].kind == NWTREES_KIND_STRING);
+        TEST_EXPECT(storage.name(13) == "one two");
+        TEST_EXPECT(storage.buffers.name_count == strlen("mainnFoosone two"));
+
+        TEST_EXPECT(nwtrees_lex(lexer, source.data(), 2048, &storage.buffers) == NWTREES_SOURCE_TOO_LARGE);
+        TEST_EXPECT(nwtrees_lex(lexer, nullptr, 0, &storage.buffers) == NWTREES_OK);
+        TEST_EXPECT(storage.buffers.token_count == 0);
+
+        nwtrees_lexer_destroy(lexer);
+
+        TEST_EXPECT(!nwtrees_lexer_create(1024, 0));
+    }
+
+    TEST_METHOD(From_C)
+    {
+        TEST_EXPECT(capi_count_tokens_from_c("void main() { }") == 6);
+        TEST_EXPECT(capi_count_tokens_from_c("int a = @;") == -1);
+    }
+
+    TEST_METHOD(NeedsSpace)
+    {
+        const std::string_view source = "SetLocalInt(oPC, \"quest_state\", 12); SendMessageToPC(oPC, \"Done\");";
+
+        nwtrees_lexer* lexer = nwtrees_lexer_create(1024, 1);
+        Storage small(4, 8, 0);
+
+        {
+            TEST_EXPECT_NO_ALLOC();
+            TEST_EXPECT(nwtrees_lex(lexer, source.data(), source.size(), &small.buffers) == NWTREES_NEEDS_SPACE);
+        }
+
+        // Every count is the whole source's, however little fit.
+        TEST_EXPECT(small.buffers.token_count == 16);
+        TEST_EXPECT(small.buffers.name_count == strlen("SetLocalIntoPCquest_stateSendMessageToPCoPCDone"));
+        TEST_EXPECT(small.buffers.error_count == 0);
+
+        Storage sized(small.buffers.token_count, small.buffers.name_count, 1);
+        TEST_EXPECT(nwtrees_lex(lexer, source.data(), source.size(), &sized.buffers) == NWTREES_OK);
+        TEST_EXPECT(sized.name(13) == "Done");
+
+        nwtrees_lexer_destroy(lexer);
+    }
+
+    TEST_METHOD(Errors)
+    {
+        const std::string_view source = "int a = @; int b = \x92; string c = \"open\nint d;";
+
+        nwtrees_lexer* first = nwtrees_lexer_create(1024, 1);
+        nwtrees_lexer* all = nwtrees_lexer_create(1024, 8);
+        Storage storage(64, 64, 8);
+
+        // Even the message of an invalid character was made room for up front.
+        {
+            TEST_EXPECT_NO_ALLOC();
+            TEST_EXPECT(nwtrees_lex(first, source.data(), source.size(), &storage.buffers) == NWTREES_LEX_ERRORS);
+        }
+
+        TEST_EXPECT(storage.buffers.error_count == 1);
+        TEST_EXPECT(storage.errors[0].code == NWTREES_ERROR_INVALID_CHARACTER);
+        TEST_EXPECT(storage.errors[0].offset == 8);
+        TEST_EXPECT(storage.buffers.token_count == 3);
+
+        {
+            TEST_EXPECT_NO_ALLOC();
+            TEST_EXPECT(nwtrees_lex(all, source.data(), source.size(), &storage.buffers) == NWTREES_LEX_ERRORS);
+        }
+
+        TEST_EXPECT(storage.buffers.error_count == 3);
+        TEST_EXPECT(storage.errors[2].code == NWTREES_ERROR_UNTERMINATED_STRING);
+        TEST_EXPECT(strcmp(nwtrees_describe_error(storage.errors[2].code), "unterminated string") == 0);
+        TEST_EXPECT(storage.name(storage.buffers.token_count - 2) == "d");
+
+        nwtrees_lexer_destroy(first);
+        nwtrees_lexer_destroy(all);
+    }
+};
@@ -0,0 +1,23 @@
+/* Built as C99, so that nothing but C creeps into the C API's header. */
+
+#include <nwtrees/CApi.h>
+
+#include <string.h>
+
+/* How many tokens source lexes to, through the C API from C; -1 if it doesn't lex cleanly into room for 16. */
+int capi_count_tokens_from_c(const char* source)
+{
+    nwtrees_token tokens[16];
+    char names[64];
+    nwtrees_error errors[1];
+    nwtrees_buffers buffers = { tokens, 16, names, sizeof(names), errors, 1, 0, 0, 0 };
+    nwtrees_lexer* lexer = nwtrees_lexer_create(1024, 1);
+    nwtrees_status status;
+
+    if (!lexer) return -1;
+
+    status = nwtrees_lex(lexer, source, strlen(source), &buffers);
+    nwtrees_lexer_destroy(lexer);
+
+    return status == NWTREES_OK ? (int)buffers.token_count : -1;
+}
@@ -0,0 +1,41 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/util/Hash.hpp>
+
+#include <string>
+
+TEST_CLASS(Hash)
+{
+    TEST_METHOD(Fnv1a)
+    {
+        TEST_EXPECT(nwtrees::hash::fnv1a("") == 2166136261u);
+        TEST_EXPECT(nwtrees::hash::fnv1a("a") == 0xE40C292Cu);
+    }
+
+    TEST_METHOD(Xxh64)
+    {
+        // Reference values from the xxHash reference implementation.
+        TEST_EXPECT(nwtrees::hash::xxh64("") == 0xEF46DB3751D8E999ull);
+        TEST_EXPECT(nwtrees::hash::xxh64("a") == 0xD24EC4F1A98C6E5Bull);
+        TEST_EXPECT(nwtrees::hash::xxh64("abc") == 0x44BC2CF5AD770999ull);
+        TEST_EXPECT(nwtrees::hash::xxh64("Nobody inspects the spammish repetition") == 0xFBCEA83C8A378BF1ull);
+    }
+
+    TEST_METHOD(Xxh64_Every_Tail)
+    {
+        // Hashing must depend on every byte, whichever path (stripes, words or bytes) it is read by.
+        std::string data(100, 'x');
+
+        for (size_t len = 0; len <= data.size(); ++len)
+        {
+            const uint64_t hash = nwtrees::hash::xxh64(std::string_view(data.data(), len));
+
+            for (size_t i = 0; i < len; ++i)
+            {
+                data[i] = 'y';
+                TEST_EXPECT(nwtrees::hash::xxh64(std::string_view(data.data(), len)) != hash);
+                data[i] = 'x';
+            }
+        }
+    }
+};
@@ -2,6 +2,10 @@
 
 #include <nwtrees/Lexer.hpp>
 
+#include <cstring>
+#include <memory_resource>
+#include <random>
+
 namespace
 {
     template <typename T>
@@ -15,6 +19,45 @@ namespace
         }
         return ret;
     }
+
+    std::string_view name(const nwtrees::LexerOutput& lex, const nwtrees::NameBufferEntry& entry)
+    {
+        return lex.text(entry);
+    }
+
+    // Compares by value, rather than by layout: the same names may live at different places in the name buffer.
+    bool same_tokens(const nwtrees::LexerOutput& lhs, const nwtrees::LexerOutput& rhs)
+    {
+        if (lhs.tokens.size() != rhs.tokens.size() || lhs.offsets != rhs.offsets || lhs.errors.size() != rhs.errors.size()) return false;
+
+        for (size_t i = 0; i < lhs.tokens.size(); ++i)
+        {
+            const nwtrees::Token& l = lhs.tokens[i];
+            const nwtrees::Token& r = rhs.tokens[i];
+
+            if (l.type != r.type) return false;
+
+            switch (l.type)
+            {
+                case nwtrees::Token::Keyword: if (l.keyword != r.keyword) return false; break;
+                case nwtrees::Token::Punctuator: if (l.punctuator != r.punctuator) return false; break;
+                case nwtrees::Token::Identifier: if (name(lhs, l.identifier_data) != name(rhs, r.identifier_data)) return false; break;
+                case nwtrees::Token::Literal:
+                    if (l.literal != r.literal) return false;
+                    if (l.literal == nwtrees::Literal::String && name(lhs, l.literal_data.str) != name(rhs, r.literal_data.str)) return false;
+                    if (l.literal != nwtrees::Literal::String && memcmp(&l.literal_data, &r.literal_data, sizeof(int)) != 0) return false;
+                    break;
+                default: break;
+            }
+        }
+
+        for (size_t i = 0; i < lhs.errors.size(); ++i)
+        {
+            if (lhs.errors[i].offset != rhs.errors[i].offset) return false;
+        }
+
+        return true;
+    }
 }
 
 TEST_CLASS(Lexer)
@@ -74,6 +117,31 @@ TEST_CLASS(Lexer)
         }
     }
 
+    TEST_METHOD(Keywords_Near_Misses)
+    {
+        // Each of these shares a keyword's length, ends or first characters, so it hashes like one (or collides with one).
+        std::string source;
+
+        for (const auto& [str, _] : nwtrees::keywords)
+        {
+            std::string changed(str);
+            changed[changed.size() / 2] = changed[changed.size() / 2] == 'z' ? 'y' : 'z';
+            std::string upper(str);
+            upper[0] = (char)(upper[0] - 'a' + 'A');
+
+            source += std::string(str) + "x " + std::string(str.substr(0, str.size() - 1)) + " " + "_" + std::string(str) + " " + changed + " " + upper + " ";
+        }
+
+        nwtrees::LexerOutput lex = nwtrees::lexer(source);
+        TEST_EXPECT(lex.errors.empty());
+        TEST_EXPECT(lex.tokens.size() == nwtrees::keywords.size() * 5);
+
+        for (const nwtrees::Token& token : lex.tokens)
+        {
+            TEST_EXPECT(token.type == nwtrees::Token::Identifier);
+        }
+    }
+
     TEST_METHOD(Identifiers)
     {
         static constexpr std::array identifiers { "integer", "floating", "stringless", "test", "obj" };
@@ -146,7 +214,7 @@ TEST_CLASS(Lexer)
 
     TEST_METHOD(Literals_Float)
     {
-        static constexpr std::array literals { "1.0", "1.", "0.1", ".1", "-.1", "-.1e5", "+.1f", "10000f", "9e5" };
+        static constexpr std::array literals { "1.0", "1.", "0.1", ".1", "-.1", "-.1e5", "+.1f", "10000f", "9e5", "1e-5", "2.5e+3f", "1e400", "-1e-400", "3.4028236e38" };
         nwtrees::LexerOutput lex = nwtrees::lexer(concat(literals).c_str());
         TEST_EXPECT(lex.tokens.size() == literals.size());
         TEST_EXPECT(lex.names.empty());
@@ -163,6 +231,37 @@ TEST_CLASS(Lexer)
         }
     }
 
+    TEST_METHOD(Literals_Int_Overflow)
+    {
+        // Saturates at the limits of a long like strtol, then truncates; so "4294967295" is -1 on LP64, but INT_MAX on Windows.
+        static constexpr std::array literals { "2147483648", "4294967295", "0xFFFFFFFF", "0x7FFFFFFFFFFFFFFF1", "99999999999999999999", "-99999999999999999999", "-9223372036854775808" };
+        nwtrees::LexerOutput lex = nwtrees::lexer(concat(literals).c_str());
+        TEST_EXPECT(lex.tokens.size() == literals.size());
+
+        for (int i = 0; i < (int)literals.size(); ++i)
+        {
+            const int as_int = (int)std::strtol(literals[i], nullptr, strstr(literals[i], "0x") ? 16 : 10);
+            TEST_EXPECT(lex.tokens[i].literal_data.integer == as_int);
+        }
+    }
+
+    TEST_METHOD(Literals_Float_Rounding)
+    {
+        // Long mantissas and extreme exponents are where a parser that isn't exactly rounded would differ.
+        std::mt19937 rng(42);
+
+        for (int i = 0; i < 2000; ++i)
+        {
+            std::string literal = std::to_string(rng() % 10) + ".";
+            for (int digit = (int)(rng() % 25); digit > 0; --digit) literal += (char)('0' + rng() % 10);
+            literal += "e" + std::to_string((int)(rng() % 90) - 45);
+
+            const nwtrees::LexerOutput lex = nwtrees::lexer(literal.c_str());
+            TEST_EXPECT(lex.tokens.size() == 1);
+            TEST_EXPECT(lex.tokens[0].literal_data.flt == (float)std::strtod(literal.c_str(), nullptr));
+        }
+    }
+
     TEST_METHOD(Punctuators)
     {
         std::string punctuators;
@@ -185,6 +284,48 @@ TEST_CLASS(Lexer)
         }
     }
 
+    TEST_METHOD(Punctuators_Maximal_Munch)
+    {
+        // '/' is left out, as it could start a comment.
+        static constexpr std::string_view chars = "&*^:,.=!>{([<-%|+?})];~";
+
+        std::mt19937 rng(7);
+
+        for (int i = 0; i < 500; ++i)
+        {
+            std::string source;
+            const size_t len = 1 + rng() % 12;
+            for (size_t j = 0; j < len; ++j) source += chars[rng() % chars.size()];
+
+            // Reference: at each point, the longest punctuator the rest of the source starts with.
+            std::vector<nwtrees::Punctuator> expected;
+
+            for (size_t pos = 0; pos < source.size(); pos += nwtrees::punctuators[(size_t)expected.back()].first.size())
+            {
+                size_t best_len = 0;
+
+                for (const auto& [str, punctuator] : nwtrees::punctuators)
+                {
+                    if (str.size() > best_len && std::string_view(source).substr(pos, str.size()) == str)
+                    {
+                        if (best_len == 0) expected.push_back(punctuator);
+                        else expected.back() = punctuator;
+                        best_len = str.size();
+                    }
+                }
+            }
+
+            const nwtrees::LexerOutput lex = nwtrees::lexer(source);
+            TEST_EXPECT(lex.errors.empty());
+            TEST_EXPECT(lex.tokens.size() == expected.size());
+
+            for (size_t j = 0; j < expected.size(); ++j)
+            {
+                TEST_EXPECT(lex.tokens[j].punctuator == expected[j]);
+            }
+        }
+    }
+
     TEST_METHOD(Invalid)
     {
         TEST_EXPECT(!nwtrees::lexer("`").errors.empty());
@@ -193,6 +334,735 @@ TEST_CLASS(Lexer)
         TEST_EXPECT(!nwtrees::lexer("@@").errors.empty());
     }
 
+    TEST_METHOD(Bounded_Input)
+    {
+        // Only the first three bytes are input; the rest of the buffer must not be looked at.
+        nwtrees::LexerOutput lex = nwtrees::lexer(std::string_view("int x", 3));
+        TEST_EXPECT(lex.tokens.size() == 1);
+        TEST_EXPECT(lex.tokens[0].type == nwtrees::Token::Keyword);
+        TEST_EXPECT(lex.tokens[0].keyword == nwtrees::Keyword::Int);
+        TEST_EXPECT(lex.errors.empty());
+
+        static constexpr char no_terminator[] = { 'o', 'P', 'C', '=', '1', '0' };
+        lex = nwtrees::lexer(std::string_view(no_terminator, sizeof(no_terminator)), std::move(lex));
+        TEST_EXPECT(lex.tokens.size() == 3);
+        TEST_EXPECT(lex.tokens[0].identifier_data.len == 3);
+        TEST_EXPECT(lex.tokens[2].literal_data.integer == 10);
+        TEST_EXPECT(lex.errors.empty());
+
+        TEST_EXPECT(!nwtrees::lexer(std::string_view("\"abc\"", 4)).errors.empty());
+        TEST_EXPECT(nwtrees::lexer(std::string_view("/* a */", 5)).errors.empty());
+        TEST_EXPECT(!nwtrees::lexer(std::string_view("a\0b", 3)).errors.empty());
+    }
+
+    TEST_METHOD(Offsets)
+    {
+        const char* code = "int x = 5;\n/* comment */ string s = \"a\"\n    \"b\";";
+
+        nwtrees::LexerOutput lex = nwtrees::lexer(code);
+        TEST_EXPECT(lex.offsets.size() == lex.tokens.size());
+
+        static constexpr std::array expected_offsets { 0, 4, 6, 8, 9, 25, 32, 34, 36, 47 };
+        TEST_EXPECT(lex.offsets.size() == expected_offsets.size());
+
+        for (size_t i = 0; i < lex.offsets.size() && i < expected_offsets.size(); ++i)
+        {
+            TEST_EXPECT(lex.offsets[i] == expected_offsets[i]);
+        }
+    }
+
+    TEST_METHOD(Error_Offset)
+    {
+        nwtrees::LexerOutput lex = nwtrees::lexer("int x;\n  x = @;");
+        TEST_EXPECT(lex.errors.size() == 1);
+        TEST_EXPECT(lex.errors[0].offset == 13);
+        TEST_EXPECT(lex.errors[0].code == nwtrees::Error::InvalidCharacter);
+        TEST_EXPECT(lex.message(lex.errors[0]) == "unexpected character '@'");
+    }
+
+    TEST_METHOD(Error_Codes)
+    {
+        TEST_EXPECT(nwtrees::lexer("\"abc").errors[0].code == nwtrees::Error::UnterminatedString);
+        TEST_EXPECT(nwtrees::lexer("12ab").errors[0].code == nwtrees::Error::InvalidNumber);
+        TEST_EXPECT(nwtrees::lexer("\x93").errors[0].code == nwtrees::Error::InvalidCharacter);
+        TEST_EXPECT(nwtrees::lexer("\xE2\x80\x9C").errors.size() == 1);
+    }
+
+    TEST_METHOD(Recover)
+    {
+        // Smart quotes (three bytes each in UTF-8) around a word, a stray Windows-1252 byte, and a bad number.
+        const char* code = "string s = \xE2\x80\x9Chi\xE2\x80\x9D;\nint n = 1 \x92 + 12ab;\nstring t = \"open\nint m;";
+
+        nwtrees::LexerOptions options;
+        options.recover = true;
+
+        const nwtrees::LexerOutput lex = nwtrees::lexer(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(lex.errors.size() == 5);
+        TEST_EXPECT(lex.errors[0].code == nwtrees::Error::InvalidCharacter);
+        TEST_EXPECT(lex.errors[0].offset == 11);
+        TEST_EXPECT(lex.errors[1].offset == 16);
+        TEST_EXPECT(lex.errors[2].code == nwtrees::Error::InvalidCharacter);
+        TEST_EXPECT(lex.errors[3].code == nwtrees::Error::InvalidNumber);
+        TEST_EXPECT(lex.errors[4].code == nwtrees::Error::UnterminatedString);
+
+        // Both smart quotes start with the same byte, so share one message.
+        TEST_EXPECT(lex.errors[0].message == lex.errors[1].message);
+        TEST_EXPECT(lex.message(lex.errors[2]) == "unexpected byte 0x92");
+        TEST_EXPECT(lex.diagnostics.size() == 2);
+
+        // Lexing carries on to the end: the last statement is "int m;".
+        TEST_EXPECT(lex.tokens.size() >= 3);
+        TEST_EXPECT(lex.tokens[lex.tokens.size() - 3].type == nwtrees::Token::Keyword);
+        TEST_EXPECT(lex.tokens[lex.tokens.size() - 1].punctuator == nwtrees::Punctuator::Semicolon);
+
+        // Without recovery, only the first error is found.
+        TEST_EXPECT(nwtrees::lexer(code).errors.size() == 1);
+    }
+
+    TEST_METHOD(Recover_MaxErrors)
+    {
+        const char* code = "int a = @; int b = $; int c = `; int d;";
+
+        nwtrees::LexerOptions options;
+        options.recover = true;
+        options.max_errors = 2;
+
+        // Lexing stops at the second error, as it would at the first without recovering.
+        const nwtrees::LexerOutput lex = nwtrees::lexer(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(lex.errors.size() == 2);
+        TEST_EXPECT(lex.errors[1].offset == 19);
+        TEST_EXPECT(lex.tokens.size() == 7);
+
+        options.max_errors = 3;
+        TEST_EXPECT(nwtrees::lexer(code, nwtrees::LexerOutput(), options).errors.size() == 3);
+        TEST_EXPECT(nwtrees::lexer(code, nwtrees::LexerOutput(), options).tokens.size() == 11);
+    }
+
+    TEST_METHOD(Interning)
+    {
+        nwtrees::LexerOptions options;
+        options.intern_names = true;
+
+        nwtrees::LexerOutput lex = nwtrees::lexer(R"(oPC = GetFirstPC(); SetLocalInt(oPC, "oP" "C", oPC);)", nwtrees::LexerOutput(), options);
+        TEST_EXPECT(lex.errors.empty());
+        TEST_EXPECT(lex.names.empty());
+        TEST_EXPECT(lex.symbols.size() == 3);
+
+        const int pc = lex.tokens[0].symbol;
+        TEST_EXPECT(lex.symbols.name(pc) == "oPC");
+        TEST_EXPECT(lex.symbols.name(lex.tokens[2].symbol) == "GetFirstPC");
+        TEST_EXPECT(lex.tokens[8].symbol == pc);
+        TEST_EXPECT(lex.tokens[10].symbol == pc); // the concatenated string shares the identifier's symbol
+    }
+
+    TEST_METHOD(Interning_Shared)
+    {
+        nwtrees::SymbolTable symbols;
+
+        nwtrees::LexerOptions options;
+        options.intern_names = true;
+        options.symbols = &symbols;
+
+        nwtrees::LexerOutput first = nwtrees::lexer("object oPC; int nCount;", nwtrees::LexerOutput(), options);
+        nwtrees::LexerOutput second = nwtrees::lexer("int nCount = GetLocalInt(oPC);", nwtrees::LexerOutput(), options);
+        TEST_EXPECT(first.symbols.size() == 0);
+        TEST_EXPECT(symbols.size() == 3);
+        TEST_EXPECT(second.tokens[1].symbol == first.tokens[4].symbol);
+        TEST_EXPECT(second.tokens[5].symbol == first.tokens[1].symbol);
+    }
+
+    TEST_METHOD(Stats)
+    {
+        const std::string_view source = "#include \"x\"\n// hi\nint a = \"b\" \"c\"; /* c */";
+
+        nwtrees::LexerStats stats;
+        const nwtrees::LexerOutput lex = nwtrees::lexer(source, nwtrees::LexerOutput(), nwtrees::LexerOptions(), stats);
+        TEST_EXPECT(same_tokens(lex, nwtrees::lexer(source)));
+
+        TEST_EXPECT(stats.inputs == 1);
+        TEST_EXPECT(stats.bytes == source.size());
+        TEST_EXPECT(stats.preprocessor_bytes == 12);
+        TEST_EXPECT(stats.comment_bytes == 5 + 7);
+        TEST_EXPECT(stats.whitespace_bytes == 2 + 5);
+
+        TEST_EXPECT(stats.tokens_by_type[nwtrees::Token::Keyword] == 1);
+        TEST_EXPECT(stats.tokens_by_type[nwtrees::Token::Identifier] == 1);
+        TEST_EXPECT(stats.tokens_by_type[nwtrees::Token::Literal] == 1);
+        TEST_EXPECT(stats.tokens_by_type[nwtrees::Token::Punctuator] == 2);
+        TEST_EXPECT(stats.tokens_by_kind[nwtrees::token_kind::of(nwtrees::Keyword::Int)] == 1);
+        TEST_EXPECT(stats.tokens_by_kind[nwtrees::token_kind::of(nwtrees::Punctuator::Semicolon)] == 1);
+        TEST_EXPECT(stats.strings_merged == 1);
+        TEST_EXPECT(stats.names_high_water == lex.names.size());
+        TEST_EXPECT(stats.tokens_high_water == 5);
+        TEST_EXPECT(stats.seek_cycles == 0 && stats.tokenize_cycles == 0);
+
+        // Counts add up over calls; high-water marks don't.
+        nwtrees::lexer("x", nwtrees::LexerOutput(), nwtrees::LexerOptions(), stats);
+        TEST_EXPECT(stats.inputs == 2);
+        TEST_EXPECT(stats.tokens_by_type[nwtrees::Token::Identifier] == 2);
+        TEST_EXPECT(stats.tokens_high_water == 5);
+
+        nwtrees::LexerStats total;
+        total.add(stats);
+        total.add(stats);
+        TEST_EXPECT(total.inputs == 4);
+        TEST_EXPECT(total.strings_merged == 2);
+        TEST_EXPECT(total.tokens_high_water == 5);
+    }
+
+    TEST_METHOD(Stats_Cycles)
+    {
+        nwtrees::LexerStats stats;
+        stats.count_cycles = true;
+        nwtrees::lexer("void main() { int x = 1; }", nwtrees::LexerOutput(), nwtrees::LexerOptions(), stats);
+        TEST_EXPECT(stats.seek_cycles + stats.tokenize_cycles > 0);
+    }
+
+    TEST_METHOD(Steady_State_No_Alloc)
+    {
+        const std::string source =
+            "#include \"nw_i0_spells\"\n"
+            "// The second pass over the same output must reuse everything the first one allocated.\n"
+            "void main() { string s = \"a\" \"b\"; float f = 1.5f; int i = 0xFF; object o = OBJECT_SELF; }\n"
+            "/* ` */ int bad = 1 ` 2;";
+
+        nwtrees::LexerOptions options;
+        options.recover = true;
+
+        nwtrees::LexerOptions interned = options;
+        interned.intern_names = true;
+
+        nwtrees::LexerOptions arrays = options;
+        arrays.layout = nwtrees::TokenLayout::Arrays;
+
+        nwtrees::LexerOptions directives = options;
+        directives.directives = true;
+
+        for (const nwtrees::LexerOptions& opts : { options, interned, arrays, directives })
+        {
+            nwtrees::LexerOutput lex = nwtrees::lexer(source, nwtrees::LexerOutput(), opts);
+            TEST_EXPECT(lex.errors.size() == 1);
+
+            {
+                TEST_EXPECT_NO_ALLOC();
+                lex = nwtrees::lexer(source, std::move(lex), opts);
+                lex = nwtrees::lexer(source, std::move(lex), opts);
+            }
+
+            TEST_EXPECT(lex.errors.size() == 1);
+        }
+
+        // Stats are only counted, never stored.
+        nwtrees::LexerStats stats;
+        nwtrees::LexerOutput lex = nwtrees::lexer(source, nwtrees::LexerOutput(), options, stats);
+
+        {
+            TEST_EXPECT_NO_ALLOC();
+            lex = nwtrees::lexer(source, std::move(lex), options, stats);
+        }
+    }
+
+    TEST_METHOD(Batch)
+    {
+        const std::array<std::string_view, 4> sources
+        {
+            "void main() { string s = \"hi\"; }",
+            "",
+            "int x = 1 @ 2;",
+            "#define A 1\nobject o = OBJECT_SELF;",
+        };
+
+        nwtrees::LexerOptions options;
+        options.directives = true;
+
+        const nwtrees::LexerBatch batch = nwtrees::lex_batch(sources, nwtrees::LexerBatch(), options);
+        TEST_EXPECT(batch.files.size() == sources.size());
+        TEST_EXPECT(batch.output.errors.size() == 1);
+        TEST_EXPECT(batch.output.directives.size() == 1);
+
+        int token_end = 0;
+
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            const nwtrees::LexerBatchFile& file = batch.files[i];
+            const nwtrees::LexerOutput single = nwtrees::lexer(sources[i], nwtrees::LexerOutput(), options);
+
+            // The ranges tile the shared arrays, in order.
+            TEST_EXPECT(file.token_begin == token_end);
+            token_end = file.token_end;
+
+            TEST_EXPECT(file.token_end - file.token_begin == (int)single.tokens.size());
+            TEST_EXPECT(file.names_end - file.names_begin == (int)single.names.size());
+            TEST_EXPECT(file.error_end - file.error_begin == (int)single.errors.size());
+            TEST_EXPECT(file.directive_end - file.directive_begin == (int)single.directives.size());
+
+            for (int j = 0; j < (int)single.tokens.size(); ++j)
+            {
+                const nwtrees::Token& expected = single.tokens[j];
+                const nwtrees::Token& token = batch.output.tokens[file.token_begin + j];
+
+                TEST_EXPECT(token.type == expected.type);
+                TEST_EXPECT(batch.output.offsets[file.token_begin + j] == single.offsets[j]);
+
+                if (token.type == nwtrees::Token::Identifier)
+                {
+                    TEST_EXPECT(token.identifier_data.idx >= file.names_begin);
+                    TEST_EXPECT(name(batch.output, token.identifier_data) == name(single, expected.identifier_data));
+                }
+            }
+
+            for (int j = 0; j < (int)single.errors.size(); ++j)
+            {
+                TEST_EXPECT(batch.output.errors[file.error_begin + j].offset == single.errors[j].offset);
+                TEST_EXPECT(batch.output.message(batch.output.errors[file.error_begin + j]) == single.message(single.errors[j]));
+            }
+        }
+
+        TEST_EXPECT(token_end == (int)batch.output.tokens.size());
+    }
+
+    TEST_METHOD(Batch_Allocations)
+    {
+        std::vector<std::string> scripts;
+        for (int i = 0; i < 200; ++i)
+        {
+            scripts.push_back("// Script " + std::to_string(i) + ", with about as much space and commentary as a real one.\n"
+                "void main()\n{\n    int nCount = " + std::to_string(i) + ";\n    SendMessageToPC(GetFirstPC(), IntToString(nCount));\n}\n");
+        }
+
+        const std::vector<std::string_view> sources(std::begin(scripts), std::end(scripts));
+
+        // One allocation for each of the tokens, offsets, names and files, however many files there are.
+        const test::AllocationCounts before = test::allocations();
+        nwtrees::LexerBatch batch = nwtrees::lex_batch(sources);
+        TEST_EXPECT(test::allocations().allocations - before.allocations <= 4);
+        TEST_EXPECT(batch.files.size() == sources.size());
+
+        {
+            TEST_EXPECT_NO_ALLOC();
+            batch = nwtrees::lex_batch(sources, std::move(batch));
+        }
+    }
+
+    TEST_METHOD(Arena)
+    {
+        const std::string source =
+            "#define ENGINE_STRUCTURE_0 effect\n"
+            "void main() { string s = \"a\" \"b\"; float f = 1.5f; int i = 0xFF; object o = OBJECT_SELF; }\n"
+            "int bad = 1 ` 2 \x92 3;";
+
+        nwtrees::LexerOptions options;
+        options.recover = true;
+        options.directives = true;
+
+        nwtrees::LexerOptions interned = options;
+        interned.intern_names = true;
+
+        const nwtrees::LexerOutput expected = nwtrees::lexer(source, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(expected.errors.size() == 2);
+
+        alignas(std::max_align_t) static std::byte buffer[64 * 1024];
+        std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+        test::CountingResource counting(&arena);
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const test::AllocationCounts before = test::allocations();
+
+            {
+                TEST_EXPECT_NO_ALLOC();
+                const nwtrees::LexerOutput lex = nwtrees::lexer(source, nwtrees::LexerOutput(&counting), options);
+                TEST_EXPECT(lex.resource() == &counting);
+                TEST_EXPECT(same_tokens(lex, expected));
+                TEST_EXPECT(lex.directives.size() == 1);
+                TEST_EXPECT(lex.message(lex.errors[1]) == expected.message(expected.errors[1]));
+
+                const nwtrees::LexerOutput symbols = nwtrees::lexer(source, nwtrees::LexerOutput(&counting), interned);
+                TEST_EXPECT(symbols.symbols.name(symbols.tokens[1].symbol) == "main");
+            }
+
+            // Everything went to the arena, and all of it goes back at once.
+            TEST_EXPECT(test::allocations().arena_allocations > before.arena_allocations);
+            arena.release();
+        }
+
+        const std::array<std::string_view, 2> sources { source, "int x = 1;" };
+
+        {
+            TEST_EXPECT_NO_ALLOC();
+            const nwtrees::LexerBatch batch = nwtrees::lex_batch(sources, nwtrees::LexerBatch(&counting), options);
+            TEST_EXPECT(batch.files.size() == sources.size());
+            TEST_EXPECT(batch.output.errors.size() == 2);
+        }
+
+        arena.release();
+    }
+
+    TEST_METHOD(Source_Names)
+    {
+        const std::string code = "void main() { string s = \"a\" \"b\"  \"c\"; object oPC = GetFirstPC(); SendMessageToPC(oPC, \"hi\"); }";
+
+        nwtrees::LexerOptions options;
+        options.source_names = true;
+
+        const nwtrees::LexerOutput copied = nwtrees::lexer(code);
+        const nwtrees::LexerOutput lex = nwtrees::lexer(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(same_tokens(lex, copied));
+        TEST_EXPECT(lex.source.data() == code.data());
+
+        // Only the merged string needed copying; everything else is where it was found.
+        TEST_EXPECT(std::string_view(lex.names.data(), lex.names.size()) == "abc");
+
+        for (size_t i = 0; i < lex.tokens.size(); ++i)
+        {
+            const nwtrees::Token& token = lex.tokens[i];
+            if (token.type != nwtrees::Token::Identifier) continue;
+            TEST_EXPECT(token.identifier_data.idx == lex.offsets[i]);
+        }
+
+        nwtrees::LexerOutput streamed;
+        nwtrees::LexerStream stream(code, streamed, options);
+        nwtrees::Token token;
+        size_t count = 0;
+
+        while (stream.next(&token))
+        {
+            const nwtrees::Token& expected = lex.tokens[count++];
+            if (token.type == nwtrees::Token::Identifier) TEST_EXPECT(name(streamed, token.identifier_data) == name(lex, expected.identifier_data));
+            if (token.type == nwtrees::Token::Literal && token.literal == nwtrees::Literal::String) TEST_EXPECT(name(streamed, token.literal_data.str) == name(lex, expected.literal_data.str));
+        }
+
+        TEST_EXPECT(count == lex.tokens.size());
+
+        // In a batch, each entry is in its own file's source, or past the end of it, in the shared names.
+        const std::string second = "x = \"1\" \"2\"; y = \"3\";";
+        const std::string_view sources[] = { code, second };
+        const nwtrees::LexerBatch batch = nwtrees::lex_batch(sources, nwtrees::LexerBatch(), options);
+        TEST_EXPECT(batch.output.source.empty());
+        TEST_EXPECT(std::string_view(batch.output.names.data(), batch.output.names.size()) == "abc12");
+
+        const nwtrees::LexerBatchFile& file = batch.files[1];
+        TEST_EXPECT(file.token_end - file.token_begin == 8);
+
+        const auto batch_text = [&](const nwtrees::NameBufferEntry& entry)
+        {
+            return entry.idx < (int)second.size() ? std::string_view(second).substr(entry.idx, entry.len)
+                : std::string_view(batch.output.names.data() + entry.idx - second.size(), entry.len);
+        };
+
+        TEST_EXPECT(batch_text(batch.output.tokens[file.token_begin].identifier_data) == "x");
+        TEST_EXPECT(batch_text(batch.output.tokens[file.token_begin + 2].literal_data.str) == "12");
+        TEST_EXPECT(batch_text(batch.output.tokens[file.token_begin + 6].literal_data.str) == "3");
+    }
+
+    TEST_METHOD(Parallel)
+    {
+        // Pieces that break a chunk starting in the wrong place: comments, strings and merges that run across lines, and errors.
+        static constexpr std::array pieces
+        {
+            "int nValue = 42;\n", "string s = \"a\" \"b\";\n", "s = \"x\"\n\"y\"\n    \"z\";\n", "/* a block\ncomment \"with\n*/ x\n",
+            "// a \"line\" comment /*\n", "#include \"inc_x\"\n", "#define MAX 10 // ten\n", "object o = GetFirstPC();\n",
+            "float f = 1.5e3;\n", "x+=-1;\n", "\"a // b /* c\"\n", "\n\n", "\"unterminated\n", "@\n",
+        };
+
+        const auto tokens_of = [](const nwtrees::LexerOutput& lex)
+        {
+            if (lex.kinds.empty()) return std::vector<nwtrees::Token>(lex.tokens.begin(), lex.tokens.end());
+            std::vector<nwtrees::Token> tokens;
+            for (size_t i = 0; i < lex.kinds.size(); ++i) tokens.push_back(nwtrees::make_token(lex.kinds[i], lex.payloads[i]));
+            return tokens;
+        };
+
+        // Everything the same, down to where each name is kept and what each symbol is numbered.
+        const auto identical = [&](const nwtrees::LexerOutput& lhs, const nwtrees::LexerOutput& rhs)
+        {
+            const std::vector<nwtrees::Token> l = tokens_of(lhs);
+            const std::vector<nwtrees::Token> r = tokens_of(rhs);
+            if (l.size() != r.size() || lhs.offsets != rhs.offsets || lhs.names != rhs.names || lhs.errors.size() != rhs.errors.size()) return false;
+            if (lhs.directives.size() != rhs.directives.size() || lhs.symbols.size() != rhs.symbols.size()) return false;
+
+            for (size_t i = 0; i < l.size(); ++i)
+            {
+                if (nwtrees::token_kind::of(l[i]) != nwtrees::token_kind::of(r[i])) return false;
+
+                // Names compare both halves of the entry (or the symbol and the length), numbers the one int (or float).
+                const bool has_name = l[i].type == nwtrees::Token::Identifier || (l[i].type == nwtrees::Token::Literal && l[i].literal == nwtrees::Literal::String);
+                const size_t payload_size = has_name ? sizeof(nwtrees::NameBufferEntry) : (l[i].type == nwtrees::Token::Literal ? sizeof(int) : 0);
+                if (memcmp(&l[i].identifier_data, &r[i].identifier_data, payload_size) != 0) return false;
+            }
+
+            for (size_t i = 0; i < lhs.errors.size(); ++i)
+            {
+                const nwtrees::Error& le = lhs.errors[i];
+                const nwtrees::Error& re = rhs.errors[i];
+                if (le.code != re.code || le.offset != re.offset || le.message != re.message || lhs.message(le) != rhs.message(re)) return false;
+            }
+
+            for (size_t i = 0; i < lhs.directives.size(); ++i)
+            {
+                const nwtrees::Directive& ld = lhs.directives[i];
+                const nwtrees::Directive& rd = rhs.directives[i];
+                if (ld.type != rd.type || ld.offset != rd.offset || ld.name.idx != rd.name.idx || ld.value.idx != rd.value.idx) return false;
+            }
+
+            return true;
+        };
+
+        std::mt19937 rng(99);
+
+        for (int i = 0; i < 60; ++i)
+        {
+            std::string source;
+            const size_t count = 20 + rng() % 200;
+
+            for (size_t j = 0; j < count; ++j)
+            {
+                // Errors are rare, so that lexing without recovery still gets somewhere.
+                const size_t piece = rng() % (rng() % 8 == 0 ? pieces.size() : pieces.size() - 2);
+                source += pieces[piece];
+            }
+
+            nwtrees::LexerOptions options;
+            options.recover = i % 2 == 0;
+            options.directives = i % 3 == 0;
+            options.intern_names = i % 5 == 1;
+            options.source_names = i % 5 == 2;
+            if (i % 4 == 3) options.layout = nwtrees::TokenLayout::Arrays;
+
+            const nwtrees::LexerOutput expected = nwtrees::lexer(source, nwtrees::LexerOutput(), options);
+
+            // Tiny chunks, so that most of them start somewhere awkward.
+            options.threads = 2 + i % 7;
+            options.chunk_min_bytes = 1 + rng() % 64;
+
+            const nwtrees::LexerOutput actual = nwtrees::lexer(source, nwtrees::LexerOutput(), options);
+            TEST_EXPECT(identical(actual, expected));
+            TEST_EXPECT(actual.source.data() == expected.source.data());
+        }
+    }
+
+    TEST_METHOD(Configs)
+    {
+        const std::string code = "#include \"inc\"\nvoid main() { string s = \"a\" \"b\"; int x = 1 @ 2; object o = OBJECT_SELF; }";
+
+        nwtrees::LexerOptions options;
+        options.recover = true;
+        options.directives = true;
+        options.source_names = true;
+
+        // The default config is lexer() itself.
+        const nwtrees::LexerOutput full = nwtrees::lexer(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(same_tokens(nwtrees::lexer<nwtrees::LexerConfig>(code, nwtrees::LexerOutput(), options), full));
+
+        // Building scripts stops at the first error, and never interns, whatever the options say.
+        nwtrees::LexerOptions compile_options = options;
+        compile_options.recover = false;
+
+        options.intern_names = true;
+        const nwtrees::LexerOutput compiled = nwtrees::lexer<nwtrees::CompileLexerConfig>(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(same_tokens(compiled, nwtrees::lexer(code, nwtrees::LexerOutput(), compile_options)));
+        TEST_EXPECT(compiled.errors.size() == 1);
+        TEST_EXPECT(compiled.tokens.size() < full.tokens.size());
+        TEST_EXPECT(compiled.symbols.size() == 0);
+        TEST_EXPECT(compiled.directives.size() == 1);
+        TEST_EXPECT(compiled.source.data() == code.data());
+
+        // Diagnostics keep going, and copy names out of a source that may change.
+        options.intern_names = false;
+        nwtrees::LexerOptions copied_options = options;
+        copied_options.source_names = false;
+
+        const nwtrees::LexerOutput diagnostics = nwtrees::lexer<nwtrees::DiagnosticsLexerConfig>(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(same_tokens(diagnostics, full));
+        TEST_EXPECT(same_tokens(diagnostics, nwtrees::lexer(code, nwtrees::LexerOutput(), copied_options)));
+        TEST_EXPECT(diagnostics.source.empty());
+        TEST_EXPECT(diagnostics.names.size() > 2);
+
+        // Neither has the arrays layout.
+        options.layout = nwtrees::TokenLayout::Arrays;
+        const nwtrees::LexerOutput structs = nwtrees::lexer<nwtrees::CompileLexerConfig>(code, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(structs.kinds.empty());
+        TEST_EXPECT(same_tokens(structs, compiled));
+    }
+
+    TEST_METHOD(Stream)
+    {
+        const char* code = "void main() { string s = \"a\" /* b */ \"c\"; int n = 0x10; }";
+
+        const nwtrees::LexerOutput batch = nwtrees::lexer(code);
+
+        nwtrees::LexerOutput output;
+        nwtrees::LexerStream stream(code, output);
+
+        nwtrees::Token token;
+        size_t count = 0;
+
+        while (stream.next(&token))
+        {
+            TEST_EXPECT(count < batch.tokens.size());
+            const nwtrees::Token& expected = batch.tokens[count];
+            TEST_EXPECT(token.type == expected.type);
+            const bool has_name = token.type == nwtrees::Token::Identifier || (token.type == nwtrees::Token::Literal && token.literal == nwtrees::Literal::String);
+            const size_t payload_size = has_name ? sizeof(nwtrees::NameBufferEntry) : (token.type == nwtrees::Token::Literal ? sizeof(int) : 0);
+            TEST_EXPECT(memcmp(&token.literal_data, &expected.literal_data, payload_size) == 0);
+            TEST_EXPECT(stream.offset() == batch.offsets[count]);
+            ++count;
+        }
+
+        TEST_EXPECT(count == batch.tokens.size());
+        TEST_EXPECT(!stream.failed());
+        TEST_EXPECT(output.names == batch.names);
+    }
+
+    TEST_METHOD(Stream_Early_Stop)
+    {
+        const char* code = "void helper() { } int StartingConditional() { return 1; } oops @";
+
+        nwtrees::LexerOutput output;
+        nwtrees::LexerStream stream(code, output);
+
+        nwtrees::Token token;
+        bool found = false;
+
+        while (!found && stream.next(&token))
+        {
+            if (token.type == nwtrees::Token::Identifier)
+            {
+                const nwtrees::NameBufferEntry& entry = token.identifier_data;
+                found = std::string_view(output.names.data() + entry.idx, entry.len) == "StartingConditional";
+            }
+        }
+
+        TEST_EXPECT(found);
+        TEST_EXPECT(stream.offset() == 22);
+        TEST_EXPECT(output.errors.empty()); // the bad token was never reached
+
+        while (stream.next(&token)) { }
+        TEST_EXPECT(stream.failed());
+        TEST_EXPECT(output.errors.size() == 1);
+        TEST_EXPECT(!stream.next(&token));
+    }
+
+    TEST_METHOD(Layout_Arrays)
+    {
+        const char* code = "void main() { if (x) { string s = \"a\" \"b\"; } int n = 0x10; float f = 1.5; }";
+
+        nwtrees::LexerOptions options;
+        options.layout = nwtrees::TokenLayout::Arrays;
+
+        const nwtrees::LexerOutput structs = nwtrees::lexer(code);
+        const nwtrees::LexerOutput arrays = nwtrees::lexer(code, nwtrees::LexerOutput(), options);
+
+        TEST_EXPECT(arrays.tokens.empty());
+        TEST_EXPECT(arrays.kinds.size() == structs.tokens.size());
+        TEST_EXPECT(arrays.payloads.size() == structs.tokens.size());
+        TEST_EXPECT(arrays.offsets == structs.offsets);
+        TEST_EXPECT(arrays.names == structs.names);
+
+        for (size_t i = 0; i < structs.tokens.size(); ++i)
+        {
+            const nwtrees::Token& expected = structs.tokens[i];
+            const nwtrees::Token actual = nwtrees::make_token(arrays.kinds[i], arrays.payloads[i]);
+            TEST_EXPECT(nwtrees::token_kind::of(actual) == nwtrees::token_kind::of(expected));
+            TEST_EXPECT(memcmp(&actual.identifier_data, &expected.identifier_data, expected.type == nwtrees::Token::Literal ? sizeof(int) : 0) == 0);
+
+            if (expected.type == nwtrees::Token::Identifier)
+            {
+                TEST_EXPECT(name(arrays, actual.identifier_data) == name(structs, expected.identifier_data));
+            }
+        }
+
+        // Bracket matching reads nothing but the kinds.
+        int depth = 0;
+        int max_depth = 0;
+
+        for (const nwtrees::TokenKind kind : arrays.kinds)
+        {
+            depth += kind == nwtrees::token_kind::of(nwtrees::Punctuator::LeftCurlyBracket);
+            depth -= kind == nwtrees::token_kind::of(nwtrees::Punctuator::RightCurlyBracket);
+            max_depth = std::max(max_depth, depth);
+        }
+
+        TEST_EXPECT(depth == 0);
+        TEST_EXPECT(max_depth == 2);
+    }
+
+    TEST_METHOD(Relex)
+    {
+        const std::string code = "void main()\n{\n    string s = \"a\" \"b\"; // done\n    int n = 10 + 2;\n}\n";
+
+        static constexpr std::array<nwtrees::LexerEdit, 10> edits =
+        {{
+            { 0, 0, "int x; " },     // before everything
+            { 5, 4, "StartingConditional" }, // replace an identifier
+            { 7, 0, "n" },       // grow an identifier from the middle
+            { 11, 0, "/*" },     // open a comment that swallows the rest
+            { 34, 0, " \"c\"" },    // another literal to merge
+            { 32, 1, "" },       // cut a literal open
+            { 38, 0, "\n" },    // end the line comment early
+            { 58, 4, "0x1F" },   // change a number
+            { 59, 0, "@" },      // introduce an error
+            { 64, 2, "" },       // remove the end
+        }};
+
+        for (const nwtrees::LexerEdit& edit : edits)
+        {
+            std::string source = code;
+            nwtrees::LexerOutput lex = nwtrees::relex(source, edit, nwtrees::lexer(source));
+
+            std::string expected_source = code;
+            expected_source.replace(edit.offset, edit.length, edit.text);
+            TEST_EXPECT(source == expected_source);
+            TEST_EXPECT(same_tokens(lex, nwtrees::lexer(source)));
+        }
+    }
+
+    TEST_METHOD(Relex_Lookahead)
+    {
+        // The third "." turns the two before it, a token back, into one "...".
+        std::string source = "f(a..);";
+        nwtrees::LexerOutput lex = nwtrees::relex(source, { 5, 0, "." }, nwtrees::lexer(source));
+        TEST_EXPECT(lex.tokens.size() == 6);
+        TEST_EXPECT(lex.tokens[3].punctuator == nwtrees::Punctuator::DotDotDot);
+        TEST_EXPECT(same_tokens(lex, nwtrees::lexer(source)));
+
+        // A digit after "1e-" turns "1e" and the "-" into one float.
+        source = "x = 1e-;";
+        lex = nwtrees::relex(source, { 7, 0, "5" }, nwtrees::lexer(source));
+        TEST_EXPECT(lex.tokens.size() == 4);
+        TEST_EXPECT(lex.tokens[2].literal_data.flt == 1e-5f);
+        TEST_EXPECT(same_tokens(lex, nwtrees::lexer(source)));
+    }
+
+    TEST_METHOD(Relex_Random)
+    {
+        static constexpr std::string_view pieces[] = { " ", "\n", "\"", "/", "*", "#", "a", "e", "1", ".", "..", "+", "-", "=", "int", "\"x\"" };
+
+        std::mt19937 rng(1234);
+        std::string source = "void main() { string s = \"a\" /* x */ \"b\"; int n = 10 + 2.5f; // y\n object o; }\n";
+        nwtrees::LexerOutput lex = nwtrees::lexer(source);
+
+        for (int i = 0; i < 2000; ++i)
+        {
+            const int offset = (int)(rng() % (source.size() + 1));
+            const int length = std::min((int)(rng() % 3), (int)source.size() - offset);
+            const std::string_view text = rng() % 4 ? pieces[rng() % std::size(pieces)] : "";
+
+            const std::string last_source = source;
+            const nwtrees::LexerOutput last_lex = lex;
+
+            lex = nwtrees::relex(source, { offset, length, text }, std::move(lex));
+            TEST_EXPECT(same_tokens(lex, nwtrees::lexer(source)));
+
+            // Errors stop the lexer, so don't build on them; carry on from the last good source instead.
+            if (!lex.errors.empty())
+            {
+                source = last_source;
+                lex = last_lex;
+            }
+        }
+    }
+
     static constexpr nwtrees::Token tk(const nwtrees::Keyword type)
     {
         nwtrees::Token tk = { nwtrees::Token::Keyword };
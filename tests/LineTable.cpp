@@ -0,0 +1,50 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/LineTable.hpp>
+
+TEST_CLASS(LineTable)
+{
+    TEST_METHOD(Empty)
+    {
+        nwtrees::LineTable lines;
+        lines.build("");
+        TEST_EXPECT(lines.line_count() == 1);
+        TEST_EXPECT(lines.locate(0).line == 0);
+        TEST_EXPECT(lines.locate(0).column == 0);
+        TEST_EXPECT(lines.line_text("", 0).empty());
+    }
+
+    TEST_METHOD(Locate)
+    {
+        const std::string_view source = "void main()\n{\n\n    int x;\n}";
+
+        nwtrees::LineTable lines;
+        lines.build(source);
+        TEST_EXPECT(lines.line_count() == 5);
+
+        const nwtrees::SourceLocation x = lines.locate((int)source.find('x'));
+        TEST_EXPECT(x.line == 3);
+        TEST_EXPECT(x.column == 8);
+
+        TEST_EXPECT(lines.locate(0).line == 0);
+        TEST_EXPECT(lines.locate(11).line == 0); // the line break belongs to the line it ends
+        TEST_EXPECT(lines.locate(12).line == 1);
+        TEST_EXPECT(lines.locate((int)source.size() - 1).line == 4);
+
+        TEST_EXPECT(lines.line_text(source, 0) == "void main()");
+        TEST_EXPECT(lines.line_text(source, 2).empty());
+        TEST_EXPECT(lines.line_text(source, 3) == "    int x;");
+        TEST_EXPECT(lines.line_text(source, 4) == "}");
+    }
+
+    TEST_METHOD(Rebuild)
+    {
+        nwtrees::LineTable lines;
+        lines.build("a\nb\nc\n");
+        TEST_EXPECT(lines.line_count() == 4);
+
+        lines.build("abc");
+        TEST_EXPECT(lines.line_count() == 1);
+        TEST_EXPECT(lines.locate(2).column == 2);
+    }
+};
@@ -0,0 +1,275 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/Preprocessor.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace
+{
+    // Sources by include name, lexed as a build would lex them.
+    class Files
+    {
+    public:
+        const nwtrees::LexedFile& add(const std::string& name, const std::string& source)
+        {
+            std::unique_ptr<Entry>& entry = m_files[name];
+            entry = std::make_unique<Entry>();
+            entry->name = name;
+            entry->source = source;
+
+            nwtrees::LexerOptions options;
+            options.directives = true;
+            options.source_names = true;
+
+            entry->file.name = entry->name;
+            entry->file.source = entry->source;
+            entry->file.output = nwtrees::lexer(entry->file.source, nwtrees::LexerOutput(), options);
+            return entry->file;
+        }
+
+        nwtrees::IncludeResolver resolver()
+        {
+            return [this](const std::string_view name, const nwtrees::LexedFile&) -> const nwtrees::LexedFile*
+            {
+                ++resolved;
+                const auto it = m_files.find(std::string(name));
+                return it == std::end(m_files) ? nullptr : &it->second->file;
+            };
+        }
+
+        int resolved = 0;
+
+    private:
+        struct Entry
+        {
+            std::string name;
+            std::string source;
+            nwtrees::LexedFile file;
+        };
+
+        std::map<std::string, std::unique_ptr<Entry>> m_files;
+    };
+
+    // Identifiers and keywords by name, everything else by its spelling.
+    std::string spell(const nwtrees::PreprocessedToken& token)
+    {
+        const nwtrees::Token& t = token.token;
+
+        switch (t.type)
+        {
+            case nwtrees::Token::Identifier: return std::string(token.output->text(t.identifier_data));
+            case nwtrees::Token::Keyword: return std::string(nwtrees::keywords[(size_t)t.keyword].first);
+            case nwtrees::Token::Punctuator: return std::string(nwtrees::punctuators[(size_t)t.punctuator].first);
+
+            case nwtrees::Token::Literal:
+                if (t.literal == nwtrees::Literal::Int) return std::to_string(t.literal_data.integer);
+                else if (t.literal == nwtrees::Literal::String) return std::string(token.output->text(t.literal_data.str));
+                else return "float";
+
+            default: return std::string();
+        }
+    }
+
+    // Each token's text, space separated.
+    std::string spell(nwtrees::TranslationUnit& unit)
+    {
+        std::string ret;
+        nwtrees::PreprocessedToken token;
+
+        while (unit.next(&token))
+        {
+            if (!ret.empty()) ret += ' ';
+            ret += spell(token);
+        }
+
+        return ret;
+    }
+}
+
+TEST_CLASS(Preprocessor)
+{
+    TEST_METHOD(Directives)
+    {
+        const std::string_view source =
+            "#include \"nw_i0_spells\"\n"
+            "  #  define   MAX_LEVEL 40 // levels\n"
+            "#pragma once\n"
+            "#define GREETING \"a // b\"\n"
+            "#include <broken>\n"
+            "int x;";
+
+        nwtrees::LexerOptions options;
+        options.directives = true;
+
+        const nwtrees::LexerOutput output = nwtrees::lexer(source, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(output.errors.empty());
+        TEST_EXPECT(output.tokens.size() == 3);
+        TEST_EXPECT(output.directives.size() == 3);
+
+        const auto text = [&](const nwtrees::NameBufferEntry& entry) { return source.substr(entry.idx, entry.len); };
+
+        TEST_EXPECT(output.directives[0].type == nwtrees::Directive::Include);
+        TEST_EXPECT(output.directives[0].offset == 0);
+        TEST_EXPECT(text(output.directives[0].name) == "nw_i0_spells");
+
+        TEST_EXPECT(output.directives[1].type == nwtrees::Directive::Define);
+        TEST_EXPECT(output.directives[1].offset == (int)source.find('#', 1));
+        TEST_EXPECT(text(output.directives[1].name) == "MAX_LEVEL");
+        TEST_EXPECT(text(output.directives[1].value) == "40");
+
+        TEST_EXPECT(text(output.directives[2].name) == "GREETING");
+        TEST_EXPECT(text(output.directives[2].value) == "\"a // b\"");
+
+        // Without the option, the same lines are skipped without a trace.
+        TEST_EXPECT(nwtrees::lexer(source).directives.empty());
+    }
+
+    TEST_METHOD(Include)
+    {
+        Files files;
+        files.add("inc_a", "int a;");
+        const nwtrees::LexedFile& root = files.add("main", "#include \"inc_a\"\nvoid main() { a = 1; }");
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        TEST_EXPECT(spell(unit) == "int a ; void main ( ) { a = 1 ; }");
+        TEST_EXPECT(unit.errors().empty());
+        TEST_EXPECT(unit.files().size() == 2);
+        TEST_EXPECT(unit.files()[0] == &root);
+    }
+
+    TEST_METHOD(Include_Between_Tokens)
+    {
+        Files files;
+        files.add("inc_a", "a");
+        files.add("inc_b", "#include \"inc_a\"\nb");
+        const nwtrees::LexedFile& root = files.add("main", "x\n#include \"inc_b\"\ny\n#include \"inc_a\"\nz");
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        TEST_EXPECT(spell(unit) == "x a b y z");
+        TEST_EXPECT(unit.files().size() == 3);
+    }
+
+    TEST_METHOD(Include_Once)
+    {
+        Files files;
+        const nwtrees::LexedFile& lib = files.add("inc_lib", "lib");
+
+        // Both files share the one lexed library, and each sees it once, however often it is asked for.
+        const nwtrees::LexedFile& first = files.add("first", "#include \"inc_lib\"\n#include \"inc_lib\"\none");
+        const nwtrees::LexedFile& second = files.add("second", "#include \"inc_lib\"\ntwo");
+
+        nwtrees::TranslationUnit first_unit(first, files.resolver());
+        nwtrees::TranslationUnit second_unit(second, files.resolver());
+        TEST_EXPECT(spell(first_unit) == "lib one");
+        TEST_EXPECT(spell(second_unit) == "lib two");
+        TEST_EXPECT(first_unit.files()[1] == &lib);
+        TEST_EXPECT(second_unit.files()[1] == &lib);
+    }
+
+    TEST_METHOD(Include_Cycle)
+    {
+        Files files;
+        files.add("inc_a", "#include \"inc_b\"\na");
+        files.add("inc_b", "#include \"inc_a\"\n#include \"main\"\nb");
+        const nwtrees::LexedFile& root = files.add("main", "#include \"inc_a\"\nmain");
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        TEST_EXPECT(spell(unit) == "b a main");
+        TEST_EXPECT(unit.errors().empty());
+    }
+
+    TEST_METHOD(Missing_Include)
+    {
+        Files files;
+        const std::string source = "x\n#include \"nowhere\"\ny";
+        const nwtrees::LexedFile& root = files.add("main", source);
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        TEST_EXPECT(spell(unit) == "x y");
+        TEST_EXPECT(unit.errors().size() == 1);
+        TEST_EXPECT(unit.errors()[0].file == &root);
+        TEST_EXPECT(unit.errors()[0].error.code == nwtrees::Error::MissingInclude);
+        TEST_EXPECT(unit.errors()[0].error.offset == (int)source.find('#'));
+        TEST_EXPECT(unit.message(unit.errors()[0]) == "nowhere");
+    }
+
+    TEST_METHOD(Define)
+    {
+        Files files;
+        files.add("inc_const", "#define MAX_LEVEL 40\n#define EMPTY\n");
+        const nwtrees::LexedFile& root = files.add("main",
+            "MAX_LEVEL\n"
+            "#include \"inc_const\"\n"
+            "x = MAX_LEVEL EMPTY;\n"
+            "#define MAX_LEVEL (MAX_LEVEL + 1)\n"
+            "y = MAX_LEVEL;");
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+
+        // Substitution starts at the #define, and a value is never expanded again.
+        TEST_EXPECT(spell(unit) == "MAX_LEVEL x = 40 ; y = ( MAX_LEVEL + 1 ) ;");
+        TEST_EXPECT(unit.errors().empty());
+    }
+
+    TEST_METHOD(Define_Lifetime)
+    {
+        Files files;
+        const nwtrees::LexedFile& root = files.add("main",
+            "#define TAG \"first\"\n"
+            "a = TAG;\n"
+            "#define LEVEL nLevel\n"
+            "#define OTHER nOther\n"
+            "#define THIRD nThird\n"
+            "b = LEVEL + OTHER + THIRD;\n"
+            "#define TAG sSecond\n"
+            "c = TAG;");
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        std::vector<nwtrees::PreprocessedToken> tokens;
+
+        nwtrees::PreprocessedToken token;
+        while (unit.next(&token)) tokens.push_back(token);
+
+        // Read only once every token is out: neither later definitions nor the redefinition may have moved the earlier ones.
+        std::string spelled;
+        for (const nwtrees::PreprocessedToken& t : tokens) spelled += spell(t) + ' ';
+
+        TEST_EXPECT(spelled == "a = first ; b = nLevel + nOther + nThird ; c = sSecond ; ");
+    }
+
+    TEST_METHOD(Define_Location)
+    {
+        Files files;
+        const std::string source = "#define GREETING \"hi\"\nx = GREETING;";
+        const nwtrees::LexedFile& root = files.add("main", source);
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        nwtrees::PreprocessedToken token;
+
+        TEST_EXPECT(unit.next(&token) && token.offset == (int)source.find('x'));
+        TEST_EXPECT(unit.next(&token) && unit.next(&token));
+
+        // The substituted string is found where the macro was used, but its text lives with the macro.
+        TEST_EXPECT(token.token.type == nwtrees::Token::Literal);
+        TEST_EXPECT(token.file == &root);
+        TEST_EXPECT(token.offset == (int)source.rfind("GREETING"));
+        TEST_EXPECT(token.output != &root.output);
+        TEST_EXPECT(token.output->text(token.token.literal_data.str) == "hi");
+    }
+
+    TEST_METHOD(Define_Error)
+    {
+        Files files;
+        const std::string source = "#define BAD 1 @\nBAD";
+        const nwtrees::LexedFile& root = files.add("main", source);
+
+        nwtrees::TranslationUnit unit(root, files.resolver());
+        TEST_EXPECT(spell(unit) == "1");
+        TEST_EXPECT(unit.errors().size() == 1);
+        TEST_EXPECT(unit.errors()[0].error.code == nwtrees::Error::InvalidCharacter);
+        TEST_EXPECT(unit.errors()[0].error.offset == (int)source.find('@'));
+        TEST_EXPECT(unit.message(unit.errors()[0]) == "unexpected character '@'");
+    }
+};
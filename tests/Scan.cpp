@@ -0,0 +1,130 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/util/Scan.hpp>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+    using ScanFunc = const char*(*)(const char*, const char*);
+
+    struct ScanPair
+    {
+        const char* name;
+        ScanFunc scan;
+        ScanFunc reference;
+    };
+
+    static constexpr ScanPair scan_pairs[] =
+    {
+        { "find_newline", &nwtrees::scan::find_newline, &nwtrees::scan::scalar::find_newline },
+        { "find_string_end", &nwtrees::scan::find_string_end, &nwtrees::scan::scalar::find_string_end },
+        { "find_comment_end", &nwtrees::scan::find_comment_end, &nwtrees::scan::scalar::find_comment_end },
+        { "skip_whitespace", &nwtrees::scan::skip_whitespace, &nwtrees::scan::scalar::skip_whitespace },
+    };
+
+    struct CountPair
+    {
+        const char* name;
+        size_t(*count)(const char*, const char*);
+        size_t(*reference)(const char*, const char*);
+    };
+
+    static constexpr CountPair count_pairs[] =
+    {
+        { "count_newlines", &nwtrees::scan::count_newlines, &nwtrees::scan::scalar::count_newlines },
+    };
+
+    // Fills a buffer with a mix of every byte the skip routines care about, at varying distances apart.
+    std::string make_mixed_input(const size_t len, unsigned int seed)
+    {
+        static constexpr char alphabet[] = { ' ', ' ', ' ', '\t', '\r', '\n', '\v', '\f', '*', '*', '/', '\"', 'a', 'b', '_', '\x80' };
+
+        std::string out(len, ' ');
+
+        for (char& ch : out)
+        {
+            seed = seed * 1103515245 + 12345;
+            ch = alphabet[(seed >> 16) % sizeof(alphabet)];
+        }
+
+        return out;
+    }
+}
+
+TEST_CLASS(Scan)
+{
+    TEST_METHOD(Empty)
+    {
+        for (const ScanPair& pair : scan_pairs)
+        {
+            const char* empty = "";
+            TEST_EXPECT(pair.scan(empty, empty) == empty);
+        }
+    }
+
+    TEST_METHOD(Matches_Scalar)
+    {
+        // Every starting alignment and length within a few blocks, so that the masked first block,
+        // later blocks and the final partial block are all covered.
+        const std::string input = make_mixed_input(160, 1);
+
+        for (const ScanPair& pair : scan_pairs)
+        {
+            for (size_t start = 0; start < input.size(); ++start)
+            {
+                for (size_t len = 0; start + len <= input.size(); ++len)
+                {
+                    const char* head = input.c_str() + start;
+                    TEST_EXPECT(pair.scan(head, head + len) == pair.reference(head, head + len));
+                }
+            }
+        }
+
+        for (const CountPair& pair : count_pairs)
+        {
+            for (size_t start = 0; start < input.size(); ++start)
+            {
+                for (size_t len = 0; start + len <= input.size(); ++len)
+                {
+                    const char* head = input.c_str() + start;
+                    TEST_EXPECT(pair.count(head, head + len) == pair.reference(head, head + len));
+                }
+            }
+        }
+    }
+
+    TEST_METHOD(Long_Runs)
+    {
+        const std::string spaces = std::string(1000, ' ') + "\t\r\n x";
+        TEST_EXPECT(*nwtrees::scan::skip_whitespace(spaces.data(), spaces.data() + spaces.size()) == 'x');
+
+        const std::string banner = "*" + std::string(1000, '*') + "/ x";
+        TEST_EXPECT(nwtrees::scan::find_comment_end(banner.data(), banner.data() + banner.size()) == banner.data() + 1001);
+
+        const std::string line = std::string(1000, '/') + "\nx";
+        TEST_EXPECT(nwtrees::scan::find_newline(line.data(), line.data() + line.size()) == line.data() + 1000);
+        TEST_EXPECT(nwtrees::scan::find_string_end(line.data(), line.data() + line.size()) == line.data() + 1000);
+    }
+
+    TEST_METHOD(Comment_End_Shares_Star)
+    {
+        // The '*' that opened a comment may also close it; the lexer has always accepted "/*/".
+        const char* input = "*/";
+        TEST_EXPECT(nwtrees::scan::find_comment_end(input, input + 2) == input + 1);
+
+        const char* unterminated = "* /";
+        TEST_EXPECT(nwtrees::scan::find_comment_end(unterminated, unterminated + 3) == unterminated + 3);
+    }
+
+    TEST_METHOD(Stops_At_End)
+    {
+        // Nothing past end counts, even a match sitting right after it in the same block.
+        const char* input = "    \n\"*/";
+        TEST_EXPECT(nwtrees::scan::skip_whitespace(input, input + 4) == input + 4);
+        TEST_EXPECT(nwtrees::scan::find_newline(input, input + 4) == input + 4);
+        TEST_EXPECT(nwtrees::scan::find_string_end(input, input + 4) == input + 4);
+        TEST_EXPECT(nwtrees::scan::find_comment_end(input + 6, input + 7) == input + 7);
+    }
+};
@@ -0,0 +1,125 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/Snapshot.hpp>
+#include <nwtrees/util/Hash.hpp>
+
+#include <cstring>
+
+namespace
+{
+    // A snapshot of output, as the build step would write it out for source.
+    nwtrees::LexerSnapshot snapshot_of(const std::string_view source, const nwtrees::LexerOutput& output)
+    {
+        return { "test.nss", source.size(), nwtrees::hash::xxh64(source), output.tokens, output.offsets,
+            std::string_view(output.names.data(), output.names.size()), output.directives };
+    }
+
+    // By value, as the names may be in the source on one side and copied on the other.
+    bool same_tokens(const nwtrees::LexerOutput& lhs, const nwtrees::LexerOutput& rhs)
+    {
+        if (lhs.tokens.size() != rhs.tokens.size() || lhs.offsets != rhs.offsets) return false;
+
+        for (size_t i = 0; i < lhs.tokens.size(); ++i)
+        {
+            const nwtrees::Token& l = lhs.tokens[i];
+            const nwtrees::Token& r = rhs.tokens[i];
+
+            if (nwtrees::token_kind::of(l) != nwtrees::token_kind::of(r)) return false;
+
+            if (l.type == nwtrees::Token::Identifier || (l.type == nwtrees::Token::Literal && l.literal == nwtrees::Literal::String))
+            {
+                if (lhs.text(l.identifier_data) != rhs.text(r.identifier_data)) return false;
+            }
+            else if (l.type == nwtrees::Token::Literal && std::memcmp(&l.literal_data, &r.literal_data, sizeof(int)) != 0)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
+
+TEST_CLASS(Snapshot)
+{
+    TEST_METHOD(Load)
+    {
+        const std::string_view source =
+            "#include \"x0_i0_stuff\"\n"
+            "#define LIMIT 10\n"
+            "int nFoo = 0x1F; float fBar = 1.5f;\n"
+            "string sName = \"first \" \"second\";\n"
+            "void main() { nFoo += LIMIT; }\n";
+
+        nwtrees::LexerOptions options;
+        options.directives = true;
+
+        const nwtrees::LexerOutput lexed = nwtrees::lexer(source, nwtrees::LexerOutput(), options);
+        TEST_EXPECT(lexed.errors.empty());
+        TEST_EXPECT(lexed.directives.size() == 2);
+
+        const nwtrees::LexerSnapshot snapshot = snapshot_of(source, lexed);
+        TEST_EXPECT(snapshot.matches(source));
+
+        nwtrees::LexerOutput loaded;
+        TEST_EXPECT(nwtrees::load_snapshot(snapshot, source, loaded, options));
+        TEST_EXPECT(same_tokens(loaded, lexed));
+        TEST_EXPECT(loaded.names == lexed.names);
+        TEST_EXPECT(loaded.directives.size() == 2);
+        TEST_EXPECT(loaded.directives[1].type == nwtrees::Directive::Define);
+
+        // Names in the source are asked for, but the snapshot's are copies; text() reads either the same.
+        options.source_names = true;
+        TEST_EXPECT(nwtrees::load_snapshot(snapshot, source, loaded, options));
+        TEST_EXPECT(loaded.source.empty());
+        TEST_EXPECT(loaded.text(loaded.tokens[loaded.tokens.size() - 5].identifier_data) == "nFoo");
+
+        // Without directives, only they are left out.
+        const nwtrees::LexerOutput plain = nwtrees::lexer(source);
+        TEST_EXPECT(nwtrees::load_snapshot(snapshot, source, loaded));
+        TEST_EXPECT(same_tokens(loaded, plain));
+        TEST_EXPECT(loaded.directives.empty());
+    }
+
+    TEST_METHOD(Mismatch)
+    {
+        const std::string_view source = "void main() { int x = 1; }";
+        const nwtrees::LexerOutput lexed = nwtrees::lexer(source);
+        const nwtrees::LexerSnapshot snapshot = snapshot_of(source, lexed);
+
+        nwtrees::LexerOutput output = nwtrees::lexer("int y;");
+        const size_t before = output.tokens.size();
+
+        // The same size, but not the same source.
+        TEST_EXPECT(!snapshot.matches("void main() { int x = 2; }"));
+        TEST_EXPECT(!nwtrees::load_snapshot(snapshot, "void main() { int x = 2; }", output));
+        TEST_EXPECT(!nwtrees::load_snapshot(snapshot, "void main() { }", output));
+
+        nwtrees::LexerOptions options;
+        options.intern_names = true;
+        TEST_EXPECT(!nwtrees::load_snapshot(snapshot, source, output, options));
+
+        options.intern_names = false;
+        options.layout = nwtrees::TokenLayout::Arrays;
+        TEST_EXPECT(!nwtrees::load_snapshot(snapshot, source, output, options));
+
+        TEST_EXPECT(output.tokens.size() == before);
+    }
+
+    TEST_METHOD(Embedded)
+    {
+        // Only there when the library was built with NWTREES_NWSCRIPT.
+        const nwtrees::LexerSnapshot* snapshot = nwtrees::nwscript_snapshot();
+        if (!snapshot) return;
+
+        TEST_EXPECT(!snapshot->name.empty());
+        TEST_EXPECT(snapshot->tokens.size() == snapshot->offsets.size());
+        TEST_EXPECT(!snapshot->tokens.empty());
+
+        for (const nwtrees::Token& token : snapshot->tokens)
+        {
+            if (token.type != nwtrees::Token::Identifier) continue;
+            TEST_EXPECT(token.identifier_data.idx >= 0 && token.identifier_data.idx + token.identifier_data.len <= (int)snapshot->names.size());
+        }
+    }
+};
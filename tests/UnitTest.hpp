@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
 
 namespace test
 {
@@ -23,6 +26,41 @@ struct UnitTest
 
 void register_unit_test(const char* class_name, const char* test_name, UnitTestFunc function);
 
+// Everything registered by TEST_METHOD and BENCHMARK_METHOD in this binary, in registration order.
+const std::vector<UnitTest>& registered_unit_tests();
+
+// Every binary that links UnitTest.cpp has its operator new and delete counted.
+struct AllocationCounts
+{
+    int64_t allocations = 0;
+    int64_t bytes = 0;
+
+    // Made through a CountingResource; these don't count towards the two above unless its upstream is operator new.
+    int64_t arena_allocations = 0;
+    int64_t arena_bytes = 0;
+};
+
+// Since the program started; subtract two to count what happened between them.
+AllocationCounts allocations();
+
+// Allocated and not yet freed.
+int64_t bytes_in_use();
+
+// Counts what is allocated from it as arena allocations, then passes it on to upstream: put one in front of an arena to
+// see how much of what would have gone to operator new went to the arena instead.
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream) : m_upstream(upstream) { }
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* data, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::pmr::memory_resource* m_upstream;
+};
+
 struct ScopedUnitTest{
     ScopedUnitTest(const char* class_name, const char* test_name, UnitTestFunc function)
     {
@@ -71,6 +109,34 @@ struct TestName
 
 void debug_break();
 
+// Fails the test if anything allocates between here and the end of the enclosing scope.
+struct NoAllocScope
+{
+    NoAllocScope(UnitTestResult& result, const char* file, const int line)
+        : result(result), file(file), line(line), before(allocations().allocations) { }
+
+    ~NoAllocScope()
+    {
+        if (allocations().allocations != before && !result.failed_condition)
+        {
+            ::test::debug_break();
+            result.failed_condition = "TEST_EXPECT_NO_ALLOC: the scope allocated";
+            result.failed_file = file;
+            result.failed_line = line;
+        }
+    }
+
+    UnitTestResult& result;
+    const char* file;
+    int line;
+    int64_t before;
+};
+
+#define _TEST_CONCAT_IMPL(lhs, rhs) lhs##rhs
+#define _TEST_CONCAT(lhs, rhs) _TEST_CONCAT_IMPL(lhs, rhs)
+
+#define TEST_EXPECT_NO_ALLOC() ::test::NoAllocScope _TEST_CONCAT(_no_alloc_, __LINE__)(test_result, __FILE__, __LINE__)
+
 #define TEST_EXPECT(cond)                             \
     do                                                \
     {                                                 \
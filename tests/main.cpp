@@ -0,0 +1,95 @@
+#include "UnitTest.hpp"
+
+#include <nwtrees/util/Assert.hpp>
+
+#include <chrono>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char** argv)
+{
+    using namespace test;
+
+    char* whitelist = argc == 2 ? argv[1] : nullptr;
+
+    const int64_t overall_bytes_before = test::bytes_in_use();
+    bool any_failures = false;
+
+    for (const UnitTest& test : registered_unit_tests())
+    {
+        char name_buf[4096];
+        sprintf(name_buf, "%s_%s", test.class_name, test.test_name);
+
+        if (whitelist && !strstr(name_buf, whitelist))
+        {
+            printf("Skipping test %s\n", name_buf);
+            continue;
+        }
+
+        printf("Running test %s ...", name_buf);
+        fflush(stdout);
+
+        nwtrees::assert::g_fail_count = 0;
+
+        const AllocationCounts allocations_before = test::allocations();
+        const int64_t bytes_before = test::bytes_in_use();
+        const auto time_before = std::chrono::high_resolution_clock::now();
+
+        UnitTestResult result = test.function();
+
+        const auto time_after = std::chrono::high_resolution_clock::now();
+        const AllocationCounts allocations_after = test::allocations();
+        const int64_t bytes_after = test::bytes_in_use();
+
+        if (result.failed_condition)
+        {
+            printf(" FAILED!\n    %s:%d\n    %s\n", result.failed_file, result.failed_line, result.failed_condition);
+            any_failures = true;
+        }
+        else if (bytes_before != bytes_after)
+        {
+            printf(" FAILED!\n    %" PRId64 " bytes before test, %" PRId64 " bytes after test. Memory leak?\n", bytes_before, bytes_after);
+            any_failures = true;
+        }
+        else if (nwtrees::assert::g_fail_count)
+        {
+            printf(" FAILED!\n    Failed %d asserts.\n", nwtrees::assert::g_fail_count);
+            any_failures = true;
+        }
+        else
+        {
+            printf(" SUCCESS! (%.2f ms, %" PRId64 " allocations, %" PRId64 " bytes",
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time_after - time_before).count() / 1000.0f / 1000.0f,
+                allocations_after.allocations - allocations_before.allocations, allocations_after.bytes - allocations_before.bytes);
+
+            if (allocations_after.arena_allocations != allocations_before.arena_allocations)
+            {
+                printf("; %" PRId64 " arena allocations, %" PRId64 " bytes",
+                    allocations_after.arena_allocations - allocations_before.arena_allocations,
+                    allocations_after.arena_bytes - allocations_before.arena_bytes);
+            }
+
+            printf(")\n");
+        }
+
+        fflush(stdout);
+
+    }
+
+    const int64_t bytes_remaining = test::bytes_in_use();
+
+    if (bytes_remaining != overall_bytes_before)
+    {
+        printf("FAILED!\n    %" PRId64 " bytes were still allocated at teardown; expected %" PRId64 ".\n", bytes_remaining, overall_bytes_before);
+        fflush(stdout);
+        any_failures = true;
+    }
+
+    if (any_failures)
+    {
+        debug_break();
+        return 1;
+    }
+}